@@ -0,0 +1,364 @@
+#include "analysis.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./core/bit-utilities.h"
+#include "./core/container.h"
+#include "./core/core.h"
+#include "./core/interrupt.h"
+#include "./core/opcode.h"
+
+/* vm starts every image here */
+#define ANALYSIS_ENTRY 0x3000
+/* device registers are never code */
+#define ANALYSIS_LIMIT MR_KBSR
+
+/* what is known about each word of memory */
+enum {
+    WORD_CODE = 1 << 0,   /* decoded as instruction */
+    WORD_LEADER = 1 << 1, /* starts a block */
+    WORD_END = 1 << 2,    /* control leaves the straight line after this instruction */
+    WORD_ENTRY = 1 << 3,  /* subroutine entry */
+    WORD_LOOP = 1 << 4,   /* target of a backward branch */
+};
+
+#define INTERRUPT_TABLE_SIZE 0x100
+
+static uint8_t word[ANALYSIS_LIMIT];
+static uint16_t work[ANALYSIS_LIMIT];
+static uint32_t work_count;
+
+static void add_leader(uint16_t address, uint8_t flags) {
+    if (address >= ANALYSIS_LIMIT) {
+        return;
+    }
+    word[address] |= flags;
+    if (!(word[address] & WORD_LEADER)) {
+        word[address] |= WORD_LEADER;
+        work[work_count++] = address;
+    }
+}
+
+/*
+ * Target of JMP/JSRR at pc when the instruction right before it in the same block loads its base register with a constant
+ */
+static uint16_t resolve(uint16_t pc, uint16_t base, uint16_t* target) {
+    if (!pc || (word[pc] & WORD_LEADER) || !(word[pc - 1] & WORD_CODE) || (word[pc - 1] & WORD_END)) {
+        return 0;
+    }
+    uint16_t prev = memory[pc - 1];
+    if (((prev >> 9) & 0x7) != base) {
+        return 0;
+    }
+    uint16_t address = pc + sign_extend(prev & 0x1FF, 9);
+    if ((prev >> 12) == OP_LEA) {
+        *target = address;
+        return 1;
+    }
+    if ((prev >> 12) == OP_LD) {
+        *target = memory[address];
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Address ST, STI or STR at pc stores to when it is known before run, STR needs its base loaded by the instruction before it
+ */
+static uint16_t store_address(uint16_t pc, uint16_t instr, uint16_t* address) {
+    uint16_t next = pc + 1;
+    switch (instr >> 12) {
+        case OP_ST:
+            *address = next + sign_extend(instr & 0x1FF, 9);
+            return 1;
+        case OP_STI:
+            *address = memory[(uint16_t)(next + sign_extend(instr & 0x1FF, 9))];
+            return 1;
+        case OP_STR: {
+            uint16_t base;
+            if (!resolve(pc, (instr >> 6) & 0x7, &base)) {
+                return 0;
+            }
+            *address = base + sign_extend(instr & 0x3F, 6);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* store installing an interrupt service routine */
+static uint16_t is_vector_store(uint16_t pc, uint16_t instr) {
+    uint16_t address;
+    return store_address(pc, instr, &address) && address >= INTERRUPT_TABLE &&
+        address < INTERRUPT_TABLE + INTERRUPT_TABLE_SIZE;
+}
+
+/* decode straight line code from a leader until control leaves it or it runs into code decoded before */
+static void walk(uint16_t start) {
+    for (uint32_t pc = start; pc < ANALYSIS_LIMIT; pc++) {
+        if (word[pc] & WORD_CODE) {
+            add_leader(pc, 0);
+            return;
+        }
+        uint16_t instr = memory[pc];
+        uint16_t op = instr >> 12;
+        /* reserved opcode is data, block before it just runs into it */
+        if (op == OP_RES) {
+            return;
+        }
+        word[pc] |= WORD_CODE;
+        uint16_t next = pc + 1;
+        uint16_t target;
+        switch (op) {
+            case OP_BR: {
+                uint16_t nzp = (instr >> 9) & 0x7;
+                /* BR with no condition never branches, word 0 is one of those */
+                if (!nzp) {
+                    break;
+                }
+                uint16_t offset = sign_extend(instr & 0x1FF, 9);
+                word[pc] |= WORD_END;
+                add_leader(next + offset, offset >> 15 ? WORD_LOOP : 0);
+                if (nzp != 0x7) {
+                    add_leader(next, 0);
+                }
+                return;
+            }
+            case OP_JMP: {
+                word[pc] |= WORD_END;
+                if (pc > start && resolve(pc, (instr >> 6) & 0x7, &target)) {
+                    add_leader(target, 0);
+                }
+                return;
+            }
+            case OP_JSR: {
+                word[pc] |= WORD_END;
+                if ((instr >> 11) & 0x1) {
+                    add_leader(next + sign_extend(instr & 0x7FF, 11), WORD_ENTRY);
+                } else if (pc > start && resolve(pc, (instr >> 6) & 0x7, &target)) {
+                    add_leader(target, WORD_ENTRY);
+                }
+                add_leader(next, 0);
+                return;
+            }
+            case OP_RTI: {
+                word[pc] |= WORD_END;
+                return;
+            }
+            case OP_TRAP: {
+                if ((instr & 0xFF) == TRAP_HALT) {
+                    word[pc] |= WORD_END;
+                    return;
+                }
+                break;
+            }
+            case OP_ST:
+            case OP_STI:
+            case OP_STR: {
+                if (pc > start && is_vector_store(pc, instr) && resolve(pc, (instr >> 9) & 0x7, &target)) {
+                    add_leader(target, 0);
+                }
+                break;
+            }
+        }
+    }
+}
+
+/* indirect JMP & JSRR, RET excluded */
+static uint16_t is_indirect(uint16_t instr) {
+    uint16_t op = instr >> 12;
+    return (op == OP_JMP && ((instr >> 6) & 0x7) != R_R7) || (op == OP_JSR && !((instr >> 11) & 0x1));
+}
+
+static void add_edge(struct analysis* a, uint16_t from, uint32_t to) {
+    if (to < ANALYSIS_LIMIT && (word[to] & WORD_CODE)) {
+        a->edges[a->header.edge_count].from = from;
+        a->edges[a->header.edge_count].to = to;
+        a->header.edge_count++;
+    }
+}
+
+static void block_edges(struct analysis* a, uint16_t last) {
+    uint16_t instr = memory[last];
+    uint16_t op = instr >> 12;
+    uint16_t next = last + 1;
+    uint16_t target;
+    if (!(word[last] & WORD_END)) {
+        add_edge(a, last, next);
+        return;
+    }
+    if (op == OP_BR) {
+        add_edge(a, last, (uint16_t)(next + sign_extend(instr & 0x1FF, 9)));
+        if (((instr >> 9) & 0x7) != 0x7) {
+            add_edge(a, last, next);
+        }
+    } else if (op == OP_JSR) {
+        if ((instr >> 11) & 0x1) {
+            add_edge(a, last, (uint16_t)(next + sign_extend(instr & 0x7FF, 11)));
+        } else if (resolve(last, (instr >> 6) & 0x7, &target)) {
+            add_edge(a, last, target);
+        }
+        add_edge(a, last, next);
+    } else if (is_indirect(instr) && resolve(last, (instr >> 6) & 0x7, &target)) {
+        add_edge(a, last, target);
+    }
+}
+
+static void analysis_alloc(struct analysis* a) {
+    a->blocks = malloc(sizeof(*a->blocks) * (a->header.block_count ? a->header.block_count : 1));
+    a->edges = malloc(sizeof(*a->edges) * (a->header.edge_count ? a->header.edge_count : 1));
+    a->entries = malloc(sizeof(*a->entries) * (a->header.entry_count ? a->header.entry_count : 1));
+    a->traps = malloc(sizeof(*a->traps) * (a->header.trap_count ? a->header.trap_count : 1));
+    a->indirects = malloc(sizeof(*a->indirects) * (a->header.indirect_count ? a->header.indirect_count : 1));
+    a->loops = malloc(sizeof(*a->loops) * (a->header.loop_count ? a->header.loop_count : 1));
+    a->vectors = malloc(sizeof(*a->vectors) * (a->header.vector_count ? a->header.vector_count : 1));
+}
+
+static uint16_t analysis_allocated(const struct analysis* a) {
+    return a->blocks && a->edges && a->entries && a->traps && a->indirects && a->loops && a->vectors;
+}
+
+uint16_t analysis_run(struct analysis* a, uint64_t image_hash) {
+    memset(word, 0, sizeof(word));
+    work_count = 0;
+    add_leader(ANALYSIS_ENTRY, 0);
+    for (uint32_t v = 0; v < INTERRUPT_TABLE_SIZE; v++) {
+        if (memory[INTERRUPT_TABLE + v]) {
+            add_leader(memory[INTERRUPT_TABLE + v], 0);
+        }
+    }
+    while (work_count) {
+        walk(work[--work_count]);
+    }
+
+    /* worst case every code word is its own block with two edges */
+    memset(a, 0, sizeof(*a));
+    a->header.block_count = a->header.entry_count = a->header.trap_count = ANALYSIS_LIMIT;
+    a->header.indirect_count = a->header.loop_count = a->header.vector_count = ANALYSIS_LIMIT;
+    a->header.edge_count = 2 * ANALYSIS_LIMIT;
+    analysis_alloc(a);
+    memcpy(a->header.magic, ANALYSIS_MAGIC, sizeof(a->header.magic));
+    a->header.version = ANALYSIS_VERSION;
+    a->header.image_hash = image_hash;
+    a->header.block_count = a->header.edge_count = a->header.entry_count = 0;
+    a->header.trap_count = a->header.indirect_count = a->header.loop_count = a->header.vector_count = 0;
+    if (!analysis_allocated(a)) {
+        analysis_free(a);
+        return 0;
+    }
+
+    for (uint32_t pc = 0; pc < ANALYSIS_LIMIT; pc++) {
+        if (!(word[pc] & WORD_CODE)) {
+            continue;
+        }
+        uint16_t instr = memory[pc];
+        if (word[pc] & WORD_ENTRY) {
+            a->entries[a->header.entry_count++] = pc;
+        }
+        if (word[pc] & WORD_LOOP) {
+            a->loops[a->header.loop_count++] = pc;
+        }
+        if ((instr >> 12) == OP_TRAP) {
+            a->traps[a->header.trap_count].address = pc;
+            a->traps[a->header.trap_count].vector = instr & 0xFF;
+            a->header.trap_count++;
+        }
+        uint16_t target;
+        if (is_indirect(instr) && !resolve(pc, (instr >> 6) & 0x7, &target)) {
+            a->indirects[a->header.indirect_count].address = pc;
+            a->indirects[a->header.indirect_count].base = (instr >> 6) & 0x7;
+            a->header.indirect_count++;
+        }
+        if (is_vector_store(pc, instr) && !resolve(pc, (instr >> 9) & 0x7, &target)) {
+            a->vectors[a->header.vector_count++] = pc;
+        }
+        /* code always starts at a leader, so a block is open here unless previous word ended one */
+        if (word[pc] & WORD_LEADER || !pc || !(word[pc - 1] & WORD_CODE) || (word[pc - 1] & WORD_END)) {
+            a->blocks[a->header.block_count].start = pc;
+            a->blocks[a->header.block_count].length = 0;
+            a->header.block_count++;
+        }
+        a->blocks[a->header.block_count - 1].length++;
+        uint32_t next = pc + 1;
+        if ((word[pc] & WORD_END) || next == ANALYSIS_LIMIT || !(word[next] & WORD_CODE) || (word[next] & WORD_LEADER)) {
+            block_edges(a, pc);
+        }
+    }
+    return 1;
+}
+
+uint64_t analysis_hash_file(uint64_t hash, const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return hash;
+    }
+    uint8_t buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        hash = container_hash(hash, buffer, read);
+    }
+    fclose(file);
+    return hash;
+}
+
+uint16_t analysis_write(const struct analysis* a, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    const struct analysis_header* h = &a->header;
+    fwrite(h, sizeof(*h), 1, file);
+    fwrite(a->blocks, sizeof(*a->blocks), h->block_count, file);
+    fwrite(a->edges, sizeof(*a->edges), h->edge_count, file);
+    fwrite(a->entries, sizeof(*a->entries), h->entry_count, file);
+    fwrite(a->traps, sizeof(*a->traps), h->trap_count, file);
+    fwrite(a->indirects, sizeof(*a->indirects), h->indirect_count, file);
+    fwrite(a->loops, sizeof(*a->loops), h->loop_count, file);
+    fwrite(a->vectors, sizeof(*a->vectors), h->vector_count, file);
+    uint16_t written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+
+uint16_t analysis_load(struct analysis* a, const char* path, uint64_t image_hash) {
+    memset(a, 0, sizeof(*a));
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    struct analysis_header* h = &a->header;
+    if (fread(h, sizeof(*h), 1, file) != 1 || memcmp(h->magic, ANALYSIS_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != ANALYSIS_VERSION || h->image_hash != image_hash || h->block_count > ANALYSIS_LIMIT ||
+        h->edge_count > 2 * ANALYSIS_LIMIT || h->entry_count > ANALYSIS_LIMIT || h->trap_count > ANALYSIS_LIMIT ||
+        h->indirect_count > ANALYSIS_LIMIT || h->loop_count > ANALYSIS_LIMIT || h->vector_count > ANALYSIS_LIMIT) {
+        fclose(file);
+        return 0;
+    }
+    analysis_alloc(a);
+    uint16_t loaded = analysis_allocated(a) &&
+        fread(a->blocks, sizeof(*a->blocks), h->block_count, file) == h->block_count &&
+        fread(a->edges, sizeof(*a->edges), h->edge_count, file) == h->edge_count &&
+        fread(a->entries, sizeof(*a->entries), h->entry_count, file) == h->entry_count &&
+        fread(a->traps, sizeof(*a->traps), h->trap_count, file) == h->trap_count &&
+        fread(a->indirects, sizeof(*a->indirects), h->indirect_count, file) == h->indirect_count &&
+        fread(a->loops, sizeof(*a->loops), h->loop_count, file) == h->loop_count &&
+        fread(a->vectors, sizeof(*a->vectors), h->vector_count, file) == h->vector_count;
+    fclose(file);
+    if (!loaded) {
+        analysis_free(a);
+    }
+    return loaded;
+}
+
+void analysis_free(struct analysis* a) {
+    free(a->blocks);
+    free(a->edges);
+    free(a->entries);
+    free(a->traps);
+    free(a->indirects);
+    free(a->loops);
+    free(a->vectors);
+    memset(a, 0, sizeof(*a));
+}
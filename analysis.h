@@ -0,0 +1,90 @@
+#ifndef _H_ANALYSIS_
+#define _H_ANALYSIS_
+
+#include<stdint.h>
+
+/*
+ * Image Analysis
+ * lc3-analyze walks loaded images from their entry points following control flow only, so data placed between code
+ * is never decoded, & writes basic blocks, control flow edges & what optimisations need from them to a sidecar file
+ * beside the first image. vm loads the sidecar at startup instead of scanning the whole memory.
+ *
+ * Entry points are PC_START, every JSR target, service routines in the interrupt vector table & resolved indirect targets.
+ * A block ends at BR, JMP, JSR, JSRR, RTI, HALT & before a reserved opcode or the start of another block.
+ * JMP & JSRR are resolved when the instruction just before them is LEA or LD of their base register, otherwise
+ * (or when another block jumps right onto them) they are recorded as unresolved indirect jumps.
+ * RET (JMP R7) is not treated as indirect, it returns past the JSR which is followed as fall through.
+ * A service routine installed at run time (LEA R0, ISR; STI R0, IVT) is an entry point as well when an ST, STI or STR
+ * into the interrupt vector table stores a register loaded by LEA or LD right before it, otherwise the store is recorded
+ * as an unresolved vector. STR is only recognised when the instruction before it loads its base register.
+ * vm scans the whole memory instead of using the sidecar when there are unresolved indirect jumps or vectors.
+ *
+ * Sidecar is keyed by image_hash, container_hash over contents of all image files in load order,
+ * vm ignores it when images changed since analysis.
+ * Layout: analysis_header followed by blocks, edges, entries, traps, indirects, loops & vectors arrays,
+ * all in host byte order.
+ */
+#define ANALYSIS_MAGIC "LC3A"
+#define ANALYSIS_VERSION 2
+#define ANALYSIS_SUFFIX ".lc3a"
+
+struct analysis_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t image_hash;
+    uint32_t block_count;
+    uint32_t edge_count;
+    uint32_t entry_count;    /* subroutine entries, JSR & resolved JSRR targets */
+    uint32_t trap_count;
+    uint32_t indirect_count; /* unresolved JMP & JSRR */
+    uint32_t loop_count;     /* backward branch targets, the only places idiom loops can start */
+    uint32_t vector_count;   /* stores into the interrupt vector table of values not known before run */
+};
+
+struct analysis_block {
+    uint16_t start;
+    uint16_t length; /* in words */
+};
+
+/* from is the instruction ending the block */
+struct analysis_edge {
+    uint16_t from;
+    uint16_t to;
+};
+
+struct analysis_trap {
+    uint16_t address;
+    uint16_t vector;
+};
+
+struct analysis_indirect {
+    uint16_t address;
+    uint16_t base; /* register holding the target */
+};
+
+struct analysis {
+    struct analysis_header header;
+    struct analysis_block* blocks;
+    struct analysis_edge* edges;
+    uint16_t* entries;
+    struct analysis_trap* traps;
+    struct analysis_indirect* indirects;
+    uint16_t* loops;
+    uint16_t* vectors; /* addresses of the unresolved vector stores */
+};
+
+/* continue container_hash over contents of the file, returns hash unchanged when file can't be read */
+uint64_t analysis_hash_file(uint64_t hash, const char* path);
+
+/* analyse code in memory[], image_hash is stored as is */
+uint16_t analysis_run(struct analysis* a, uint64_t image_hash);
+
+uint16_t analysis_write(const struct analysis* a, const char* path);
+
+/* load sidecar, returns 0 when it is missing, malformed or was made for other images */
+uint16_t analysis_load(struct analysis* a, const char* path, uint64_t image_hash);
+
+void analysis_free(struct analysis* a);
+
+#endif
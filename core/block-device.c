@@ -0,0 +1,116 @@
+#include<stdint.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "block-device.h"
+#include "core.h"
+
+static uint16_t* disk;
+static size_t disk_bytes;
+static uint16_t disk_sectors;
+static int disk_writable;
+static int disk_fd = -1;
+static int disk_prot;
+
+static void block_command_write(uint16_t address, uint16_t val) {
+    uint16_t sector = memory[MR_BDSEC];
+    uint16_t buffer = memory[MR_BDADR];
+    memory[MR_BDCMD] = val;
+
+    if (sector >= disk_sectors || !range_is_ram(buffer, BLOCK_SECTOR_WORDS)) {
+        memory[MR_BDSR] = BD_STATUS_READY | BD_STATUS_ERROR;
+        return;
+    }
+    uint16_t* data = disk + (size_t)sector * BLOCK_SECTOR_WORDS;
+    switch (val) {
+        case BD_CMD_READ: {
+            memcpy(memory + buffer, data, BLOCK_SECTOR_WORDS * sizeof(uint16_t));
+            memory_written(buffer, BLOCK_SECTOR_WORDS);
+            break;
+        }
+        case BD_CMD_WRITE: {
+            if (!disk_writable) {
+                memory[MR_BDSR] = BD_STATUS_READY | BD_STATUS_ERROR;
+                return;
+            }
+            memcpy(data, memory + buffer, BLOCK_SECTOR_WORDS * sizeof(uint16_t));
+            break;
+        }
+        default:
+            memory[MR_BDSR] = BD_STATUS_READY | BD_STATUS_ERROR;
+            return;
+    }
+    memory[MR_BDSR] = BD_STATUS_READY;
+}
+
+/* sector count is fixed when device is opened */
+static void block_count_write(uint16_t address, uint16_t val) {
+}
+
+uint16_t block_device_open(const char* path) {
+    int prot = PROT_READ | PROT_WRITE;
+    int fd = open(path, O_RDWR);
+    disk_writable = 1;
+    if (fd < 0) {
+        fd = open(path, O_RDONLY);
+        prot = PROT_READ;
+        disk_writable = 0;
+    }
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return 0;
+    }
+    size_t sectors = st.st_size / (BLOCK_SECTOR_WORDS * sizeof(uint16_t));
+    if (sectors > 0xFFFF) {
+        sectors = 0xFFFF;
+    }
+    disk_bytes = sectors * BLOCK_SECTOR_WORDS * sizeof(uint16_t);
+    if (disk_bytes) {
+        void* map = mmap(NULL, disk_bytes, prot, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return 0;
+        }
+        disk = map;
+    }
+    /* descriptor is kept so block_device_private can map the file again */
+    disk_fd = fd;
+    disk_prot = prot;
+    disk_sectors = sectors;
+
+    device_register(MR_BDSR, NULL, NULL);
+    device_register(MR_BDSEC, NULL, NULL);
+    device_register(MR_BDADR, NULL, NULL);
+    device_register(MR_BDCMD, NULL, block_command_write);
+    device_register(MR_BDCNT, NULL, block_count_write);
+    memory[MR_BDSR] = BD_STATUS_READY;
+    memory[MR_BDCNT] = disk_sectors;
+    return 1;
+}
+
+uint16_t block_device_private() {
+    if (!disk) {
+        return 1;
+    }
+    /* replaces the shared mapping at the same address, sectors are copied from the file on first write */
+    void* map = mmap(disk, disk_bytes, disk_prot | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, disk_fd, 0);
+    return map != MAP_FAILED;
+}
+
+void block_device_close() {
+    if (disk) {
+        munmap(disk, disk_bytes);
+        disk = NULL;
+    }
+    if (disk_fd >= 0) {
+        close(disk_fd);
+        disk_fd = -1;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef _H_BLOCK_DEVICE_
+#define _H_BLOCK_DEVICE_
+#include<stdint.h>
+
+/*
+ * Block Storage Device
+ * Host file is mapped with mmap & exposed to guest as array of sectors, each sector is 256 words (512 bytes)
+ * words are kept in host byte order so a transfer is a single memcpy between the mapping & memory[]
+ *
+ * Registers
+ * 1. BDSR  -> status, bit 15 ready, bit 0 error of the last command
+ * 2. BDSEC -> sector number for the next command
+ * 3. BDADR -> guest buffer address, sector is copied to/from [BDADR, BDADR + 256)
+ * 4. BDCMD -> writing a command starts the transfer, transfer is complete by the time store returns
+ * 5. BDCNT -> number of sectors in the device (read only)
+ *
+ * A transfer fails (error bit set) if the sector is out of range, the buffer wraps past 0xFFFF or overlaps a device page,
+ * or a write is issued on a device opened read only.
+ */
+#define BLOCK_SECTOR_WORDS 256
+
+enum {
+    BD_CMD_READ = 1,  /* copy sector into guest memory */
+    BD_CMD_WRITE = 2, /* copy guest memory into sector */
+};
+
+enum {
+    BD_STATUS_ERROR = 1 << 0,
+    BD_STATUS_READY = 1 << 15,
+};
+
+/*
+ * Map host file & register block device registers, returns 0 if file can't be opened or mapped
+ */
+uint16_t block_device_open(const char* path);
+
+/*
+ * Map host file copy on write, guest writes stay in this process & never reach the file or other processes
+ * sharing the mapping, used by lockstep engines forked from one loaded machine. Returns 0 if remapping fails
+ */
+uint16_t block_device_private();
+
+/* unmap host file, dirty sectors are written back by the kernel */
+void block_device_close();
+
+#endif
@@ -0,0 +1,665 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<unistd.h>
+#include <sys/ioctl.h>
+
+#include "console.h"
+#include "device.h"
+#include "telemetry.h"
+
+#define SCREEN_MAX_ROWS 100
+#define SCREEN_MAX_COLS 250
+#define ATTR_MAX 4096
+#define ATTR_UNKNOWN 0xFFFF
+#define CSI_MAX 64
+#define ESC_SEQ_MAX 256
+#define RUN_GAP 4
+
+/* Frame coalescing state, see console_coalesce */
+
+struct cell {
+    char ch;
+    uint16_t attr; /* index in attrs, 0 is terminal default */
+};
+
+static int coalescing;
+static uint64_t frame_ns;
+static uint64_t last_frame;
+static int dirty;
+
+static int rows;
+static int cols;
+static struct cell screen[SCREEN_MAX_ROWS][SCREEN_MAX_COLS]; /* what guest has drawn */
+static struct cell shown[SCREEN_MAX_ROWS][SCREEN_MAX_COLS];  /* what terminal displays */
+static int row;
+static int col;
+static uint16_t attr;
+
+/*
+ * SGR state, parameters of every ESC[m are applied on top of it like the terminal does
+ * colors are COLOR_DEFAULT, COLOR_PALETTE | index or COLOR_RGB | 0xRRGGBB
+ */
+enum {
+    SGR_BOLD = 1 << 0,
+    SGR_DIM = 1 << 1,
+    SGR_ITALIC = 1 << 2,
+    SGR_UNDERLINE = 1 << 3,
+    SGR_BLINK = 1 << 4,
+    SGR_REVERSE = 1 << 5,
+    SGR_HIDDEN = 1 << 6,
+    SGR_STRIKE = 1 << 7,
+};
+#define COLOR_DEFAULT 0
+#define COLOR_PALETTE 0x1000000
+#define COLOR_RGB 0x2000000
+
+struct sgr {
+    uint8_t flags;
+    uint32_t fg;
+    uint32_t bg;
+};
+static struct sgr pen;
+
+/* cursor & pen saved by ESC 7 or ESC[s */
+static int saved_row;
+static int saved_col;
+static struct sgr saved_pen;
+
+/*
+ * SGR states seen so far, cells refer to them by index
+ * a guest using more than ATTR_MAX distinct combinations gets the rest drawn with the default attribute
+ */
+static struct sgr attrs[ATTR_MAX];
+static int attr_count;
+
+/* escape sequence parser */
+enum {
+    PARSE_TEXT = 0,
+    PARSE_ESC,
+    PARSE_CSI,
+    PARSE_ESC_INTERMEDIATE, /* ESC ( B & other escapes with intermediate bytes */
+    PARSE_STRING,           /* OSC, DCS, SOS, PM & APC up to BEL or ESC \ */
+    PARSE_STRING_ESC,       /* ESC inside a string, ESC \ ends it */
+};
+static int parse_state;
+static char csi[CSI_MAX];
+static int csi_len;
+
+/*
+ * escape sequences the virtual screen doesn't interpret are collected here & forwarded whole,
+ * a string longer than the buffer is streamed to the terminal & frames wait until it ends
+ */
+static char esc_seq[ESC_SEQ_MAX];
+static size_t esc_seq_len;
+static int esc_streamed;
+
+/* sequences that don't draw anything (cursor visibility, modes), forwarded with the next frame */
+static char passthrough[256];
+static size_t passthrough_len;
+
+static char frame[SCREEN_MAX_ROWS * SCREEN_MAX_COLS * 8];
+static size_t frame_len;
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int console_getc() {
+    /* guest is about to block for input, it must see what it drew & readers of telemetry where it waits */
+    device_idle();
+    console_sync();
+    int c = getchar();
+    if (c != EOF) {
+        telemetry_add(&telemetry->bytes_in, 1);
+    }
+    return c;
+}
+
+static void clear_cells(int from_row, int from_col, int to_row, int to_col) {
+    for (int r = from_row; r <= to_row; r++) {
+        int start = r == from_row ? from_col : 0;
+        int end = r == to_row ? to_col : cols - 1;
+        for (int c = start; c <= end; c++) {
+            screen[r][c].ch = ' ';
+            screen[r][c].attr = 0;
+        }
+    }
+}
+
+static void scroll_up() {
+    memmove(screen[0], screen[1], sizeof(screen[0]) * (rows - 1));
+    clear_cells(rows - 1, 0, rows - 1, cols - 1);
+}
+
+static void scroll_down() {
+    memmove(screen[1], screen[0], sizeof(screen[0]) * (rows - 1));
+    clear_cells(0, 0, 0, cols - 1);
+}
+
+static void previous_line() {
+    if (row) {
+        row--;
+    } else {
+        scroll_down();
+    }
+}
+
+static void next_line() {
+    row++;
+    if (row == rows) {
+        scroll_up();
+        row = rows - 1;
+    }
+}
+
+static uint16_t intern_attr(const struct sgr* state) {
+    for (int i = 0; i < attr_count; i++) {
+        if (memcmp(&attrs[i], state, sizeof(*state)) == 0) {
+            return i;
+        }
+    }
+    if (attr_count == ATTR_MAX) {
+        return 0;
+    }
+    attrs[attr_count] = *state;
+    return attr_count++;
+}
+
+/* ESC[38;5;n & ESC[38;2;r;g;b, returns number of parameters used after the 38/48 */
+static int extended_color(const int* params, int count, uint32_t* color) {
+    if (count >= 2 && params[0] == 5) {
+        *color = COLOR_PALETTE | (params[1] & 0xFF);
+        return 2;
+    }
+    if (count >= 4 && params[0] == 2) {
+        *color = COLOR_RGB | (params[1] & 0xFF) << 16 | (params[2] & 0xFF) << 8 | (params[3] & 0xFF);
+        return 4;
+    }
+    return count;
+}
+
+static void apply_sgr(const char* csi) {
+    static const uint8_t set[10] = {0, SGR_BOLD, SGR_DIM, SGR_ITALIC, SGR_UNDERLINE, SGR_BLINK, SGR_BLINK, SGR_REVERSE, SGR_HIDDEN, SGR_STRIKE};
+    int params[CSI_MAX];
+    int count = 0;
+    /* empty parameter means 0 */
+    for (const char* p = csi; p && count < CSI_MAX; count++) {
+        params[count] = atoi(p);
+        p = strchr(p, ';');
+        if (p) {
+            p++;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        int v = params[i];
+        if (v == 0) {
+            memset(&pen, 0, sizeof(pen));
+        } else if (v < 10) {
+            pen.flags |= set[v];
+        } else if (v == 22) {
+            pen.flags &= ~(SGR_BOLD | SGR_DIM);
+        } else if (v >= 23 && v <= 29 && v != 26) {
+            pen.flags &= ~set[v - 20];
+        } else if ((v >= 30 && v <= 37) || (v >= 90 && v <= 97)) {
+            pen.fg = COLOR_PALETTE | (v >= 90 ? v - 90 + 8 : v - 30);
+        } else if ((v >= 40 && v <= 47) || (v >= 100 && v <= 107)) {
+            pen.bg = COLOR_PALETTE | (v >= 100 ? v - 100 + 8 : v - 40);
+        } else if (v == 38) {
+            i += extended_color(params + i + 1, count - i - 1, &pen.fg);
+        } else if (v == 48) {
+            i += extended_color(params + i + 1, count - i - 1, &pen.bg);
+        } else if (v == 39) {
+            pen.fg = COLOR_DEFAULT;
+        } else if (v == 49) {
+            pen.bg = COLOR_DEFAULT;
+        }
+    }
+    attr = intern_attr(&pen);
+}
+
+static int clamp(int v, int lo, int hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static void render();
+
+/* frame is rendered first when sequence doesn't fit, so nothing is dropped & earlier output keeps its order */
+static void passthrough_add(const char* s, size_t len) {
+    if (passthrough_len + len > sizeof(passthrough)) {
+        render();
+    }
+    if (len > sizeof(passthrough)) {
+        fwrite(s, 1, len, stdout);
+        return;
+    }
+    memcpy(passthrough + passthrough_len, s, len);
+    passthrough_len += len;
+}
+
+static void cursor_save() {
+    saved_row = row;
+    saved_col = col;
+    saved_pen = pen;
+}
+
+static void cursor_restore() {
+    row = clamp(saved_row, 0, rows - 1);
+    col = clamp(saved_col, 0, cols);
+    pen = saved_pen;
+    attr = intern_attr(&pen);
+}
+
+static int csi_param(int index, int fallback) {
+    const char* p = csi;
+    for (int i = 0; i < index && p; i++) {
+        p = strchr(p, ';');
+        if (p) {
+            p++;
+        }
+    }
+    if (!p || *p < '0' || *p > '9') {
+        return fallback;
+    }
+    return atoi(p);
+}
+
+static void csi_execute(char final) {
+    switch (final) {
+        case 'H':
+        case 'f': {
+            row = clamp(csi_param(0, 1) - 1, 0, rows - 1);
+            col = clamp(csi_param(1, 1) - 1, 0, cols - 1);
+            break;
+        }
+        case 'A': {
+            row = clamp(row - csi_param(0, 1), 0, rows - 1);
+            break;
+        }
+        case 'B': {
+            row = clamp(row + csi_param(0, 1), 0, rows - 1);
+            break;
+        }
+        case 'C': {
+            col = clamp(col + csi_param(0, 1), 0, cols - 1);
+            break;
+        }
+        case 'D': {
+            col = clamp(col - csi_param(0, 1), 0, cols - 1);
+            break;
+        }
+        case 'J': {
+            int mode = csi_param(0, 0);
+            if (mode == 0) {
+                clear_cells(row, col, rows - 1, cols - 1);
+            } else if (mode == 1) {
+                clear_cells(0, 0, row, col);
+            } else {
+                clear_cells(0, 0, rows - 1, cols - 1);
+            }
+            break;
+        }
+        case 'K': {
+            int mode = csi_param(0, 0);
+            if (mode == 0) {
+                clear_cells(row, col, row, cols - 1);
+            } else if (mode == 1) {
+                clear_cells(row, 0, row, col);
+            } else {
+                clear_cells(row, 0, row, cols - 1);
+            }
+            break;
+        }
+        case 's': {
+            if (!csi[0]) {
+                cursor_save();
+                break;
+            }
+            goto forward;
+        }
+        case 'u': {
+            if (!csi[0]) {
+                cursor_restore();
+                break;
+            }
+            goto forward;
+        }
+        case 'm': {
+            /* ESC[>...m & friends are not SGR */
+            if ((csi[0] >= '0' && csi[0] <= '9') || csi[0] == ';' || !csi[0]) {
+                apply_sgr(csi);
+                break;
+            }
+        }
+        /* fall through */
+        default:
+        forward: {
+            /* mode changes like ESC[?25l, forwarded as is */
+            char seq[CSI_MAX + 3];
+            int len = snprintf(seq, sizeof(seq), "\033[%s%c", csi, final);
+            passthrough_add(seq, len);
+            break;
+        }
+    }
+}
+
+static void esc_seq_add(char c) {
+    if (esc_seq_len == sizeof(esc_seq)) {
+        if (!esc_streamed) {
+            /* everything before the string has to reach the terminal first */
+            render();
+            esc_streamed = 1;
+        }
+        fwrite(esc_seq, 1, esc_seq_len, stdout);
+        esc_seq_len = 0;
+    }
+    esc_seq[esc_seq_len++] = c;
+}
+
+static void esc_seq_end() {
+    if (esc_streamed) {
+        fwrite(esc_seq, 1, esc_seq_len, stdout);
+        esc_streamed = 0;
+    } else {
+        passthrough_add(esc_seq, esc_seq_len);
+    }
+    esc_seq_len = 0;
+    parse_state = PARSE_TEXT;
+}
+
+/* ESC followed by c, sequences that move the cursor are applied to the virtual screen, others are forwarded */
+static void esc_execute(char c) {
+    parse_state = PARSE_TEXT;
+    esc_seq_len = 0;
+    esc_seq_add('\033');
+    esc_seq_add(c);
+    switch (c) {
+        case '[': {
+            parse_state = PARSE_CSI;
+            csi_len = 0;
+            csi[0] = 0;
+            break;
+        }
+        case ']':
+        case 'P':
+        case 'X':
+        case '^':
+        case '_': {
+            parse_state = PARSE_STRING;
+            break;
+        }
+        case 'c': {
+            clear_cells(0, 0, rows - 1, cols - 1);
+            row = col = 0;
+            memset(&pen, 0, sizeof(pen));
+            attr = intern_attr(&pen);
+            break;
+        }
+        case '7': {
+            cursor_save();
+            break;
+        }
+        case '8': {
+            cursor_restore();
+            break;
+        }
+        case 'D': {
+            next_line();
+            break;
+        }
+        case 'E': {
+            col = 0;
+            next_line();
+            break;
+        }
+        case 'M': {
+            previous_line();
+            break;
+        }
+        case '\033': {
+            parse_state = PARSE_ESC;
+            break;
+        }
+        default: {
+            if (c >= 0x20 && c <= 0x2F) {
+                parse_state = PARSE_ESC_INTERMEDIATE;
+            } else if (c >= 0x30 && c <= 0x7E) {
+                esc_seq_end();
+            }
+            break;
+        }
+    }
+}
+
+static void screen_putc(char c) {
+    switch (parse_state) {
+        case PARSE_ESC: {
+            esc_execute(c);
+            return;
+        }
+        case PARSE_ESC_INTERMEDIATE: {
+            esc_seq_add(c);
+            if (c >= 0x30 && c <= 0x7E) {
+                esc_seq_end();
+            }
+            return;
+        }
+        case PARSE_STRING: {
+            if (c == '\033') {
+                parse_state = PARSE_STRING_ESC;
+                return;
+            }
+            esc_seq_add(c);
+            if (c == '\a') {
+                esc_seq_end();
+            }
+            return;
+        }
+        case PARSE_STRING_ESC: {
+            /* string ends at ESC \, any other escape ends it too & starts a new sequence */
+            esc_seq_add('\033');
+            esc_seq_add('\\');
+            esc_seq_end();
+            if (c != '\\') {
+                esc_execute(c);
+            }
+            return;
+        }
+        case PARSE_CSI: {
+            if (c >= 0x40 && c <= 0x7E) {
+                csi[csi_len] = 0;
+                csi_execute(c);
+                parse_state = PARSE_TEXT;
+            } else if (csi_len < CSI_MAX - 1) {
+                csi[csi_len++] = c;
+            }
+            return;
+        }
+    }
+    switch (c) {
+        case '\033': {
+            parse_state = PARSE_ESC;
+            break;
+        }
+        case '\n': {
+            /* terminal output processing turns \n into \r\n */
+            col = 0;
+            next_line();
+            break;
+        }
+        case '\r': {
+            col = 0;
+            break;
+        }
+        case '\b': {
+            if (col) {
+                col--;
+            }
+            break;
+        }
+        case '\t': {
+            col = clamp((col / 8 + 1) * 8, 0, cols - 1);
+            break;
+        }
+        default: {
+            if ((unsigned char)c < 0x20 || c == 0x7F) {
+                break;
+            }
+            if (col == cols) {
+                col = 0;
+                next_line();
+            }
+            screen[row][col].ch = c;
+            screen[row][col].attr = attr;
+            col++;
+            break;
+        }
+    }
+}
+
+void console_putc(char c) {
+    telemetry_add(&telemetry->bytes_out, 1);
+    if (!coalescing) {
+        putc(c, stdout);
+        return;
+    }
+    screen_putc(c);
+    dirty = 1;
+}
+
+/* full frame buffer is written out, nothing is dropped so shown always matches the terminal */
+static void emit(const char* s, size_t len) {
+    if (frame_len + len > sizeof(frame)) {
+        fwrite(frame, 1, frame_len, stdout);
+        frame_len = 0;
+    }
+    memcpy(frame + frame_len, s, len);
+    frame_len += len;
+}
+
+static int color_params(char* out, size_t size, uint32_t color, int base) {
+    uint32_t n = color & 0xFFFFFF;
+    if (color & COLOR_RGB) {
+        return snprintf(out, size, ";%d;2;%u;%u;%u", base + 8, n >> 16, (n >> 8) & 0xFF, n & 0xFF);
+    }
+    if (n < 8) {
+        return snprintf(out, size, ";%u", base + n);
+    }
+    if (n < 16) {
+        return snprintf(out, size, ";%u", base + 60 + n - 8);
+    }
+    return snprintf(out, size, ";%d;5;%u", base + 8, n);
+}
+
+/* whole state from reset, so it doesn't depend on what terminal had before */
+static void emit_attr(uint16_t a) {
+    static const char codes[8] = {'1', '2', '3', '4', '5', '7', '8', '9'};
+    char seq[64] = "\033[0";
+    size_t len = strlen(seq);
+    for (int bit = 0; bit < 8; bit++) {
+        if (attrs[a].flags & (1 << bit)) {
+            seq[len++] = ';';
+            seq[len++] = codes[bit];
+        }
+    }
+    if (attrs[a].fg != COLOR_DEFAULT) {
+        len += color_params(seq + len, sizeof(seq) - len, attrs[a].fg, 30);
+    }
+    if (attrs[a].bg != COLOR_DEFAULT) {
+        len += color_params(seq + len, sizeof(seq) - len, attrs[a].bg, 40);
+    }
+    seq[len++] = 'm';
+    emit(seq, len);
+}
+
+/*
+ * Send terminal only the cells that changed since last frame
+ * each run of changed cells costs one cursor move, attribute is only re-sent when it changes
+ */
+static void render() {
+    frame_len = 0;
+    emit(passthrough, passthrough_len);
+    passthrough_len = 0;
+    /* terminal attribute is unknown after passthrough, ATTR_UNKNOWN forces it to be sent */
+    uint16_t term_attr = ATTR_UNKNOWN;
+    char seq[32];
+    for (int r = 0; r < rows; r++) {
+        int c = 0;
+        while (c < cols) {
+            if (screen[r][c].ch == shown[r][c].ch && screen[r][c].attr == shown[r][c].attr) {
+                c++;
+                continue;
+            }
+            emit(seq, snprintf(seq, sizeof(seq), "\033[%d;%dH", r + 1, c + 1));
+            /* run continues over short unchanged gaps, resending a few cells is cheaper than another cursor move */
+            int end = c;
+            for (int next = c; next < cols && next - end <= RUN_GAP; next++) {
+                if (screen[r][next].ch != shown[r][next].ch || screen[r][next].attr != shown[r][next].attr) {
+                    end = next + 1;
+                }
+            }
+            for (; c < end; c++) {
+                if (screen[r][c].attr != term_attr) {
+                    term_attr = screen[r][c].attr;
+                    emit_attr(term_attr);
+                }
+                emit(&screen[r][c].ch, 1);
+                shown[r][c] = screen[r][c];
+            }
+        }
+    }
+    if (term_attr != ATTR_UNKNOWN && term_attr != attr) {
+        emit_attr(attr);
+    }
+    emit(seq, snprintf(seq, sizeof(seq), "\033[%d;%dH", row + 1, (col < cols ? col : cols - 1) + 1));
+    fwrite(frame, 1, frame_len, stdout);
+    fflush(stdout);
+    dirty = 0;
+    last_frame = now_ns();
+}
+
+void console_flush() {
+    if (!coalescing || esc_streamed) {
+        fflush(stdout);
+        return;
+    }
+    if (dirty && now_ns() - last_frame >= frame_ns) {
+        render();
+    }
+}
+
+void console_sync() {
+    if (!coalescing || esc_streamed) {
+        fflush(stdout);
+        return;
+    }
+    if (dirty || passthrough_len) {
+        render();
+    }
+}
+
+void console_coalesce(int fps) {
+    struct winsize ws;
+    rows = 24;
+    cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row && ws.ws_col) {
+        rows = ws.ws_row;
+        cols = ws.ws_col;
+    }
+    rows = clamp(rows, 1, SCREEN_MAX_ROWS);
+    cols = clamp(cols, 1, SCREEN_MAX_COLS);
+    frame_ns = 1000000000ULL / (fps > 0 ? fps : 30);
+    memset(&pen, 0, sizeof(pen));
+    attr_count = 0;
+    attr = intern_attr(&pen);
+    clear_cells(0, 0, rows - 1, cols - 1);
+    memcpy(shown, screen, sizeof(screen));
+    /* start from a known blank terminal so shown matches it */
+    fputs("\033[0m\033[2J\033[H", stdout);
+    fflush(stdout);
+    coalescing = 1;
+    atexit(console_sync);
+}
@@ -0,0 +1,37 @@
+#ifndef _H_CONSOLE_
+#define _H_CONSOLE_
+
+/*
+ * Console
+ * All guest input & output goes through here instead of calling stdio directly, so it can be counted for telemetry
+ * & coalesced into frames for screen redrawing guests
+ */
+
+/* read a character from keyboard, EOF at end of input */
+int console_getc();
+
+/* write a character to the display, it is buffered until console_flush */
+void console_putc(char c);
+
+/*
+ * push buffered output to the terminal
+ * when coalescing, a frame is only sent if the last one is older than the frame interval
+ */
+void console_flush();
+
+/* push everything to the terminal now, called before host blocks for input or vm stops */
+void console_sync();
+
+/*
+ * Frame Coalescing
+ * Output is drawn on a virtual screen the size of the terminal instead of going straight to it, understanding
+ * clear screen (ESC[J), clear line (ESC[K), cursor movement (ESC[H, ESC[A-D, ESC D, ESC E, ESC M), save & restore
+ * cursor (ESC 7, ESC 8, ESC[s, ESC[u), reset (ESC c) & attributes (ESC[m).
+ * At most fps frames per second the terminal is sent only the cells that changed, a guest redrawing the whole screen
+ * after every key costs only the difference. Other escape sequences, including strings like OSC up to BEL or ESC \,
+ * are forwarded unchanged with the next frame.
+ * Guest output past the bottom line scrolls the virtual screen, there is no scrollback.
+ */
+void console_coalesce(int fps);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _H_CONTAINER_
+#define _H_CONTAINER_
+#include<stddef.h>
+#include<stdint.h>
+
+/*
+ * Container Image Format
+ * Optional alternative to .obj for big images, made of sections that each have their own origin.
+ * Everything is stored in host byte order & data of every section starts at a CONTAINER_ALIGN boundary in the file,
+ * so the loader maps the file & copies sections into memory[] without byte swapping.
+ *
+ *              +---------------------------------------+  offset 0
+ *              | container_header                      |
+ *              | container_section * section_count     |
+ *              | container_symbol * symbol_count       |  symbol_offset
+ *              | symbol names, 0 terminated            |  strings_offset
+ *              +---------------------------------------+  padded to CONTAINER_ALIGN
+ *              | section data, words in host order     |  section.offset
+ *              +---------------------------------------+  padded to CONTAINER_ALIGN, next section ...
+ *
+ * Zero fill sections (SECTION_ZERO) have no data in the file, loader clears their range.
+ * hash is container_hash of the whole file with the hash field set to 0, checked before anything is loaded.
+ * endian holds CONTAINER_ENDIAN as written by the producing host, file from a host of other byte order is rejected.
+ */
+#define CONTAINER_MAGIC "LC3C"
+#define CONTAINER_VERSION 1
+#define CONTAINER_ENDIAN 0x0102
+#define CONTAINER_ALIGN 4096
+
+enum {
+    SECTION_ZERO = 1 << 0, /* range is cleared, no data in file */
+};
+
+struct container_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t endian;
+    uint32_t section_count;
+    uint32_t symbol_count;
+    uint64_t symbol_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t hash;
+};
+
+struct container_section {
+    uint16_t origin;
+    uint16_t flags;
+    uint32_t words; /* origin + words never goes past 0xFFFF */
+    uint64_t offset; /* file offset of data, 0 for SECTION_ZERO */
+};
+
+struct container_symbol {
+    uint16_t address;
+    uint16_t reserved;
+    uint32_t name; /* offset into symbol names */
+};
+
+/*
+ * FNV-1a, pass CONTAINER_HASH_SEED for the first block & previous result to continue over the next one
+ */
+#define CONTAINER_HASH_SEED 0xcbf29ce484222325ULL
+
+static inline uint64_t container_hash(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#endif
@@ -1,13 +1,14 @@
 #ifndef _H_CORE_
 #define _H_CORE_
 #include<stdint.h>
+#include "device.h"
 /*
 /// Memory Storage
 /// Out vm supports total of 65,536 different address locations which is 2^16 bits each can store upto 16bit value
 /// 2^16 x 16 bits = 128KB <- total memory of out vm
 */
 #define MEMORY_MAX (1 << 16)
-uint16_t memory[MEMORY_MAX];
+extern uint16_t memory[MEMORY_MAX];
 
 /*
  * Register will be used by cpu to do arithmetic operations
@@ -27,19 +28,36 @@ enum {
     R_COND,  // Condition flags
     R_COUNT  // Representing total registers count in vm
 };
-uint16_t reg[R_COUNT];
+extern uint16_t reg[R_COUNT];
 
 /* Memoery Mapped registers
  * Some special registers are not accessible from normal register table. Instead, a special address is reserved for them in memoery.
  * To read & write to this registers, you just read & write their memoery locations. these registers are used to interact with special hardware.
  *
- * LC-3 has two memoery mapped registers.
+ * LC-3 memoery mapped registers, each one is served by a device registered in device.c
  * 1. keyboard status register (KBSR) -> whether the key has been pressed
  * 2. keyboard data register (KBDR) -> which key has been pressed
+ * 3. display status register (DSR) -> whether the display is ready to accept a character
+ * 4. display data register (DDR) -> character to be written to the display
+ * 5. machine control register (MCR) -> bit 15 is the clock enable, clearing it stops the machine
+ * 6. timer status/control (TMR) & timer interval (TMI) -> programmable interval timer, interval in milliseconds
+ * 7. processor status register (PSR) -> privilege, priority level & condition codes, see interrupt.h
+ * 8. block device registers (BDSR, BDSEC, BDADR, BDCMD, BDCNT) -> see block-device.h
  */
 enum {
     MR_KBSR = 0xFE00, /* keyboard status */
     MR_KBDR = 0xFE02, /* keyboard data */
+    MR_DSR = 0xFE04,  /* display status */
+    MR_DDR = 0xFE06,  /* display data */
+    MR_TMR = 0xFE08,  /* timer status & control */
+    MR_TMI = 0xFE0A,  /* timer interval */
+    MR_BDSR = 0xFE10,  /* block device status */
+    MR_BDSEC = 0xFE12, /* block device sector number */
+    MR_BDADR = 0xFE14, /* block device guest buffer address */
+    MR_BDCMD = 0xFE16, /* block device command */
+    MR_BDCNT = 0xFE18, /* block device sector count */
+    MR_PSR = 0xFFFC,  /* processor status */
+    MR_MCR = 0xFFFE,  /* machine control */
 };
 /*
  * R_COND stores the conditions flags providing information about most recent executed calculation
@@ -51,8 +69,29 @@ enum {
     FL_NEG = 1 << 2, /* N */
 };
 
-uint16_t mem_read(uint16_t address);
-void mem_write(uint16_t loc, uint16_t val);
+/*
+ * For reading data from addr space at given location
+ * memory mapped registers make reading from memory a little complecated, so every page carries an attribute in page_attr.
+ * only pages holding device registers take the slow path into device_read, all other loads are a direct array access
+ */
+static inline uint16_t mem_read(uint16_t address) {
+    if (page_attr[address >> PAGE_SHIFT] & PAGE_READ_HOOK) {
+        return device_read(address);
+    }
+    return memory[address];
+}
+
+/*
+ * For Writing data to addr space at given location & what value need to be written
+ * same as mem_read, only device pages & tracked pages go through device_write
+ */
+static inline void mem_write(uint16_t loc, uint16_t val) {
+    if (page_attr[loc >> PAGE_SHIFT] & (PAGE_WRITE_HOOK | PAGE_TRACKED)) {
+        device_write(loc, val);
+        return;
+    }
+    memory[loc] = val;
+}
 /*
  * Any time value is written to register we need to update flags to indicate the sign of the register
  * left most bit 1 means the value is negative
@@ -0,0 +1,305 @@
+#include<stdint.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<time.h>
+#include<unistd.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#include "device.h"
+#include "console.h"
+#include "core.h"
+#include "interrupt.h"
+#include "telemetry.h"
+
+uint8_t page_attr[PAGE_COUNT];
+
+struct device_slot {
+    device_read_fn read;
+    device_write_fn write;
+};
+
+/*
+ * Callback table of device pages, allocated only for pages which hold a device register
+ * indexed by page number & then by offset inside the page
+ */
+static struct device_slot* device_pages[PAGE_COUNT];
+
+static device_track_fn write_tracker;
+static device_idle_fn idle_hook;
+
+void device_register(uint16_t address, device_read_fn read, device_write_fn write) {
+    uint16_t page = address >> PAGE_SHIFT;
+    if (!device_pages[page]) {
+        device_pages[page] = calloc(1 << PAGE_SHIFT, sizeof(struct device_slot));
+        if (!device_pages[page]) {
+            return;
+        }
+    }
+    struct device_slot* slot = &device_pages[page][address & ((1 << PAGE_SHIFT) - 1)];
+    slot->read = read;
+    slot->write = write;
+    page_attr[page] |= PAGE_DEVICE;
+}
+
+uint16_t range_is_ram(uint16_t address, uint32_t count) {
+    if ((uint32_t)address + count > (1 << 16)) {
+        return 0;
+    }
+    if (!count) {
+        return 1;
+    }
+    uint16_t last = (address + count - 1) >> PAGE_SHIFT;
+    for (uint16_t page = address >> PAGE_SHIFT; page <= last; page++) {
+        if (page_attr[page] & PAGE_DEVICE) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+uint16_t device_read(uint16_t address) {
+    struct device_slot* slots = device_pages[address >> PAGE_SHIFT];
+    if (slots) {
+        struct device_slot* slot = &slots[address & ((1 << PAGE_SHIFT) - 1)];
+        if (slot->read) {
+            return slot->read(address);
+        }
+    }
+    return memory[address];
+}
+
+void device_track_writes(device_track_fn tracker) {
+    write_tracker = tracker;
+    for (int page = 0; page < PAGE_COUNT; page++) {
+        if (tracker) {
+            page_attr[page] |= PAGE_TRACKED;
+        } else {
+            page_attr[page] &= ~PAGE_TRACKED;
+        }
+    }
+}
+
+void memory_written(uint16_t address, uint32_t count) {
+    if (write_tracker) {
+        write_tracker(address, count);
+    }
+}
+
+void device_write(uint16_t address, uint16_t val) {
+    if (page_attr[address >> PAGE_SHIFT] & PAGE_TRACKED) {
+        write_tracker(address, 1);
+    }
+    struct device_slot* slots = device_pages[address >> PAGE_SHIFT];
+    if (slots) {
+        struct device_slot* slot = &slots[address & ((1 << PAGE_SHIFT) - 1)];
+        if (slot->write) {
+            slot->write(address, val);
+            return;
+        }
+    }
+    memory[address] = val;
+}
+
+/* Keyboard */
+
+static int keyboard_closed;
+
+uint16_t check_key() {
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(STDIN_FILENO, &readfds);
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+    return select(1, &readfds, NULL, NULL, &timeout) != 0;
+}
+
+static void keyboard_update_request() {
+    if ((memory[MR_KBSR] & KBSR_READY) && (memory[MR_KBSR] & KBSR_IE)) {
+        interrupt_request(INT_KEYBOARD, PL_KEYBOARD);
+    } else {
+        interrupt_cancel(INT_KEYBOARD);
+    }
+}
+
+/*
+ * Poll the host keyboard, if key has been pressed it is latched in KBDR & bit 15 of KBSR is set
+ * key stays latched until guest reads KBDR
+ */
+static void keyboard_poll() {
+    if (!(memory[MR_KBSR] & KBSR_READY) && !keyboard_closed && check_key()) {
+        int c = console_getc();
+        /* stdin stays readable after end of file, stop polling it instead of latching EOF forever */
+        if (c == EOF) {
+            keyboard_closed = 1;
+            return;
+        }
+        memory[MR_KBSR] |= KBSR_READY;
+        memory[MR_KBDR] = c;
+        keyboard_update_request();
+    }
+}
+
+static uint16_t keyboard_status_read(uint16_t address) {
+    telemetry_add(&telemetry->kbsr_polls, 1);
+    /* guest polling for a key is waiting for the user, let pending frame reach the terminal */
+    console_flush();
+    keyboard_poll();
+    return memory[MR_KBSR];
+}
+
+/* only interrupt enable bit is writable */
+static void keyboard_status_write(uint16_t address, uint16_t val) {
+    memory[MR_KBSR] = (memory[MR_KBSR] & KBSR_READY) | (val & KBSR_IE);
+    keyboard_update_request();
+}
+
+static uint16_t keyboard_data_read(uint16_t address) {
+    memory[MR_KBSR] &= ~KBSR_READY;
+    keyboard_update_request();
+    return memory[MR_KBDR];
+}
+
+/* Display */
+
+/* host terminal is always ready to accept a character */
+static uint16_t display_status_read(uint16_t address) {
+    return (1 << 15);
+}
+
+static void display_data_write(uint16_t address, uint16_t val) {
+    memory[MR_DDR] = val;
+    console_putc((char)val);
+    console_flush();
+}
+
+/* Machine Control */
+
+/*
+ * clearing bit 15 (clock enable) stops the machine, main loop checks the bit after each instruction
+ */
+static void machine_control_write(uint16_t address, uint16_t val) {
+    memory[MR_MCR] = val;
+    if (!(val >> 15)) {
+        console_sync();
+    }
+}
+
+/* Timer */
+
+static uint16_t timer_interval;
+static struct timespec timer_deadline;
+
+static int64_t timespec_ms_until(const struct timespec* t) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(t->tv_sec - now.tv_sec) * 1000 + (t->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+static void timer_arm() {
+    clock_gettime(CLOCK_MONOTONIC, &timer_deadline);
+    timer_deadline.tv_sec += timer_interval / 1000;
+    timer_deadline.tv_nsec += (long)(timer_interval % 1000) * 1000000;
+    if (timer_deadline.tv_nsec >= 1000000000) {
+        timer_deadline.tv_sec++;
+        timer_deadline.tv_nsec -= 1000000000;
+    }
+}
+
+static void timer_update_request() {
+    if ((memory[MR_TMR] & TMR_FIRED) && (memory[MR_TMR] & TMR_IE)) {
+        interrupt_request(INT_TIMER, PL_TIMER);
+    } else {
+        interrupt_cancel(INT_TIMER);
+    }
+}
+
+static void timer_poll() {
+    if (timer_interval && timespec_ms_until(&timer_deadline) <= 0) {
+        memory[MR_TMR] |= TMR_FIRED;
+        timer_arm();
+        timer_update_request();
+    }
+}
+
+/* reading TMR acknowledges the expiry */
+static uint16_t timer_status_read(uint16_t address) {
+    timer_poll();
+    uint16_t status = memory[MR_TMR];
+    memory[MR_TMR] &= ~TMR_FIRED;
+    timer_update_request();
+    return status;
+}
+
+static void timer_status_write(uint16_t address, uint16_t val) {
+    memory[MR_TMR] = (memory[MR_TMR] & TMR_FIRED) | (val & TMR_IE);
+    timer_update_request();
+}
+
+/* writing interval restarts the timer, 0 stops it */
+static void timer_interval_write(uint16_t address, uint16_t val) {
+    memory[MR_TMI] = val;
+    timer_interval = val;
+    if (timer_interval) {
+        timer_arm();
+    }
+}
+
+void device_poll() {
+    console_flush();
+    if (memory[MR_KBSR] & KBSR_IE) {
+        keyboard_poll();
+    }
+    timer_poll();
+}
+
+void device_wait() {
+    int keyboard = memory[MR_KBSR] & KBSR_IE;
+    int timer = timer_interval && (memory[MR_TMR] & TMR_IE);
+    if ((!keyboard && !timer) || interrupt_pending) {
+        return;
+    }
+    struct timeval timeout;
+    struct timeval* wait = NULL;
+    if (timer) {
+        int64_t ms = timespec_ms_until(&timer_deadline);
+        if (ms < 0) {
+            ms = 0;
+        }
+        timeout.tv_sec = ms / 1000;
+        timeout.tv_usec = (ms % 1000) * 1000;
+        wait = &timeout;
+    }
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    if (keyboard && !(memory[MR_KBSR] & KBSR_READY) && !keyboard_closed) {
+        FD_SET(STDIN_FILENO, &readfds);
+    }
+    device_idle();
+    console_sync();
+    select(1, &readfds, NULL, NULL, wait);
+    device_poll();
+}
+
+void device_on_idle(device_idle_fn hook) {
+    idle_hook = hook;
+}
+
+void device_idle() {
+    if (idle_hook) {
+        idle_hook();
+    }
+}
+
+void device_setup() {
+    device_register(MR_KBSR, keyboard_status_read, keyboard_status_write);
+    device_register(MR_KBDR, keyboard_data_read, NULL);
+    device_register(MR_DSR, display_status_read, NULL);
+    device_register(MR_DDR, NULL, display_data_write);
+    device_register(MR_TMR, timer_status_read, timer_status_write);
+    device_register(MR_TMI, NULL, timer_interval_write);
+    device_register(MR_MCR, NULL, machine_control_write);
+    memory[MR_MCR] = (1 << 15);
+}
@@ -0,0 +1,100 @@
+#ifndef _H_DEVICE_
+#define _H_DEVICE_
+#include<stdint.h>
+
+/*
+ * Memory Pages
+ * Address space is split into 256 pages of 256 words each, page number is the high byte of the address
+ *              +----------------+----------------+
+ *              |  Page (8bit)   |  Offset (8bit) |
+ *              +----------------+----------------+
+ *              | Bits: 15 - 8   |  Bits: 7 - 0   |
+ *              +----------------+----------------+
+ * Every page carries an attribute, pages with no attribute are plain ram and are accessed directly.
+ * Pages holding device registers (0xFE00 & 0xFF00) are marked so loads & stores into them take the slow path into the device callbacks.
+ */
+#define PAGE_SHIFT 8
+#define PAGE_COUNT (1 << (16 - PAGE_SHIFT))
+
+enum {
+    PAGE_READ_HOOK = 1 << 0,  /* loads from this page go through device_read */
+    PAGE_WRITE_HOOK = 1 << 1, /* stores to this page go through device_write */
+    PAGE_DEVICE = PAGE_READ_HOOK | PAGE_WRITE_HOOK,
+    PAGE_TRACKED = 1 << 2,    /* stores to this page are reported to the write tracker, see device_track_writes */
+};
+extern uint8_t page_attr[PAGE_COUNT];
+
+/*
+ * Device callbacks
+ * read is called when guest loads from the register, its return value is what guest sees
+ * write is called when guest stores to the register
+ * either of them can be NULL, in that case the access goes to the backing word in memory[] same as plain ram
+ */
+typedef uint16_t (*device_read_fn)(uint16_t address);
+typedef void (*device_write_fn)(uint16_t address, uint16_t val);
+
+/*
+ * Register device register at given address, the page containing the address is marked as device page
+ */
+void device_register(uint16_t address, device_read_fn read, device_write_fn write);
+
+/*
+ * Whether [address, address + count) is plain ram without wrapping past 0xFFFF
+ * such range can be accessed in bulk with memcpy/memset without skipping any device callback
+ * code writing such range directly must report it with memory_written
+ */
+uint16_t range_is_ram(uint16_t address, uint32_t count);
+
+/*
+ * Write Tracking
+ * once a tracker is installed every page is marked PAGE_TRACKED, so every guest store reaches device_write & is reported.
+ * bulk writers (native traps, idioms, block device) report the ranges they write with memory_written.
+ * used by lockstep mode to find memory written between checkpoints, without a tracker memory_written does nothing
+ */
+typedef void (*device_track_fn)(uint16_t address, uint32_t count);
+void device_track_writes(device_track_fn tracker);
+void memory_written(uint16_t address, uint32_t count);
+
+/* slow path of mem_read & mem_write for device pages */
+uint16_t device_read(uint16_t address);
+void device_write(uint16_t address, uint16_t val);
+
+/*
+ * KBSR[15] key is ready in KBDR, cleared when KBDR is read. KBSR[14] keyboard interrupt enable
+ * TMR[15] timer expired, cleared when TMR is read. TMR[14] timer interrupt enable
+ */
+enum {
+    KBSR_READY = 1 << 15,
+    KBSR_IE = 1 << 14,
+    TMR_FIRED = 1 << 15,
+    TMR_IE = 1 << 14,
+};
+
+/*
+ * Register the standard LC-3 devices
+ * keyboard (KBSR, KBDR), display (DSR, DDR), timer (TMR, TMI) & machine control register (MCR)
+ */
+void device_setup();
+
+/*
+ * Check keyboard & timer for events that raise interrupts, called by main loop every DEVICE_POLL_INTERVAL instructions
+ */
+/* must be a power of 2, main loop checks it with a mask */
+#define DEVICE_POLL_INTERVAL 1024
+void device_poll();
+
+/*
+ * Guest is idle waiting for an interrupt, block the host until key is pressed or timer expires
+ * returns right away if no interrupt source is enabled so guest keeps its original behaviour
+ */
+void device_wait();
+
+/*
+ * Idle hook runs right before the host blocks on the guest's behalf, in device_wait & console_getc,
+ * main loop publishes telemetry of the sleeping guest from it
+ */
+typedef void (*device_idle_fn)();
+void device_on_idle(device_idle_fn hook);
+void device_idle();
+
+#endif
@@ -0,0 +1,140 @@
+#include<stdint.h>
+
+#include "interrupt.h"
+#include "core.h"
+
+#define INTERRUPT_SOURCES 8
+
+uint16_t interrupt_pending;
+
+/* privilege & priority part of PSR, condition codes live in reg[R_COND] */
+static uint16_t psr;
+static uint16_t saved_ssp;
+static uint16_t saved_usp;
+
+static struct {
+    uint16_t vector;
+    uint16_t priority;
+} requests[INTERRUPT_SOURCES];
+static int request_count;
+
+static void update_pending() {
+    uint16_t level = (psr & PSR_PRIORITY) >> 8;
+    interrupt_pending = 0;
+    for (int i = 0; i < request_count; i++) {
+        if (requests[i].priority > level) {
+            interrupt_pending = 1;
+        }
+    }
+}
+
+static uint16_t psr_read(uint16_t address) {
+    return psr | (reg[R_COND] & 0x7);
+}
+
+/*
+ * Only supervisor can change PSR, priority & condition codes are taken from the value
+ * privilege can only change through interrupt & RTI so stacks stay consistent
+ */
+static void psr_write(uint16_t address, uint16_t val) {
+    if (psr & PSR_USER) {
+        return;
+    }
+    psr = (psr & PSR_USER) | (val & PSR_PRIORITY);
+    reg[R_COND] = val & 0x7;
+    update_pending();
+}
+
+void interrupt_setup() {
+    device_register(MR_PSR, psr_read, psr_write);
+    psr = PSR_USER;
+    saved_ssp = 0x3000;
+    request_count = 0;
+    update_pending();
+}
+
+void interrupt_request(uint16_t vector, uint16_t priority) {
+    for (int i = 0; i < request_count; i++) {
+        if (requests[i].vector == vector) {
+            return;
+        }
+    }
+    if (request_count == INTERRUPT_SOURCES) {
+        return;
+    }
+    requests[request_count].vector = vector;
+    requests[request_count].priority = priority;
+    request_count++;
+    update_pending();
+}
+
+void interrupt_cancel(uint16_t vector) {
+    for (int i = 0; i < request_count; i++) {
+        if (requests[i].vector == vector) {
+            requests[i] = requests[--request_count];
+            break;
+        }
+    }
+    update_pending();
+}
+
+/*
+ * Push PSR & PC to supervisor stack & continue at service routine of the vector
+ */
+static void enter_supervisor(uint16_t vector, uint16_t priority) {
+    uint16_t old_psr = psr | (reg[R_COND] & 0x7);
+    if (psr & PSR_USER) {
+        saved_usp = reg[R_R6];
+        reg[R_R6] = saved_ssp;
+    }
+    mem_write(--reg[R_R6], old_psr);
+    mem_write(--reg[R_R6], reg[R_PC]);
+    psr = (priority << 8) & PSR_PRIORITY;
+    reg[R_PC] = mem_read(INTERRUPT_TABLE + vector);
+    update_pending();
+}
+
+void interrupt_service() {
+    uint16_t level = (psr & PSR_PRIORITY) >> 8;
+    int best = -1;
+    for (int i = 0; i < request_count; i++) {
+        if (requests[i].priority > level && (best < 0 || requests[i].priority > requests[best].priority)) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        interrupt_pending = 0;
+        return;
+    }
+    uint16_t vector = requests[best].vector;
+    /* no service routine installed, drop the request instead of jumping to 0x0000 */
+    if (!memory[INTERRUPT_TABLE + vector]) {
+        interrupt_cancel(vector);
+        return;
+    }
+    enter_supervisor(vector, requests[best].priority);
+}
+
+uint16_t interrupt_exception(uint16_t vector) {
+    if (!memory[INTERRUPT_TABLE + vector]) {
+        return 0;
+    }
+    enter_supervisor(vector, (psr & PSR_PRIORITY) >> 8);
+    return 1;
+}
+
+uint16_t interrupt_return() {
+    if (psr & PSR_USER) {
+        return interrupt_exception(INT_PRIVILEGE);
+    }
+    reg[R_PC] = mem_read(reg[R_R6]++);
+    uint16_t new_psr = mem_read(reg[R_R6]++);
+    psr = new_psr & (PSR_USER | PSR_PRIORITY);
+    reg[R_COND] = new_psr & 0x7;
+    if (psr & PSR_USER) {
+        saved_ssp = reg[R_R6];
+        reg[R_R6] = saved_usp;
+    }
+    update_pending();
+    return 1;
+}
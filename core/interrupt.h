@@ -0,0 +1,72 @@
+#ifndef _H_INTERRUPT_
+#define _H_INTERRUPT_
+#include<stdint.h>
+
+/*
+ * Processor Status Register (PSR)
+ * +-------------------------------------------------------------+
+ * | Pr(1bit) | 0000 0 | PL(3bit) | 0000 0 | N(1bit) Z(1bit) P(1bit) |
+ * +-------------------------------------------------------------+
+ * Pr[15] privilege, 1 -> user mode, 0 -> supervisor mode
+ * PL[10:8] priority level of the running program, interrupt is only taken if its priority is higher than PL
+ * NZP[2:0] condition codes, these live in reg[R_COND] & are merged in when PSR is read or pushed
+ *
+ * Program starts in user mode at priority 0 with supervisor stack pointer at 0x3000
+ */
+enum {
+    PSR_USER = 1 << 15,
+    PSR_PRIORITY = 0x7 << 8,
+};
+
+/*
+ * Interrupt Vector Table
+ * 0x0100 - 0x01FF, entry at INTERRUPT_TABLE + vector holds the address of the service routine
+ * vectors below 0x80 are exceptions, vectors from 0x80 are device interrupts
+ */
+#define INTERRUPT_TABLE 0x0100
+
+enum {
+    INT_PRIVILEGE = 0x00,      /* RTI executed in user mode */
+    INT_ILLEGAL_OPCODE = 0x01, /* reserved opcode */
+    INT_KEYBOARD = 0x80,       /* key pressed with KBSR[14] set */
+    INT_TIMER = 0x81,          /* timer expired with TMR[14] set */
+};
+
+enum {
+    PL_KEYBOARD = 4,
+    PL_TIMER = 5,
+};
+
+/*
+ * set when a requested interrupt has higher priority than the running program, main loop calls interrupt_service when set
+ */
+extern uint16_t interrupt_pending;
+
+/* register PSR & enter user mode */
+void interrupt_setup();
+
+/*
+ * Device asks for / withdraws an interrupt, request stays until device cancels it (level triggered)
+ */
+void interrupt_request(uint16_t vector, uint16_t priority);
+void interrupt_cancel(uint16_t vector);
+
+/*
+ * Take the highest priority pending interrupt
+ * PSR & PC are pushed to supervisor stack (switching R6 to saved SSP when coming from user mode) & PC is loaded from vector table
+ */
+void interrupt_service();
+
+/*
+ * Take an exception, returns 0 when vector table has no service routine for it
+ */
+uint16_t interrupt_exception(uint16_t vector);
+
+/*
+ * Return from interrupt (RTI)
+ * pops PC & PSR from supervisor stack, switches R6 back to saved USP when returning to user mode
+ * in user mode this raises privilege exception, returns 0 when it can't be handled
+ */
+uint16_t interrupt_return();
+
+#endif
@@ -21,7 +21,7 @@ enum {
     OP_AND,    /* bitwise and */
     OP_LDR,    /* load register */
     OP_STR,    /* store register */
-    OP_RTI,    /* unused */
+    OP_RTI,    /* return from interrupt */
     OP_NOT,    /* bitwise not */
     OP_LDI,    /* load indirect */
     OP_STI,    /* store indirect */
@@ -42,4 +42,16 @@ enum {
     TRAP_HALT = 0x25,  /* halt the program */
 };
 
+/* Native accelerator traps
+ * not part of LC-3, only registered when vm is started with --native-traps
+ */
+enum {
+    TRAP_MUL = 0x30,    /* R0 = R0 * R1 */
+    TRAP_DIV = 0x31,    /* R0 = R0 / R1, R1 = R0 % R1 (signed) */
+    TRAP_MOD = 0x32,    /* R0 = R0 % R1 (signed) */
+    TRAP_MEMCPY = 0x33, /* copy R2 words from [R1] to [R0] */
+    TRAP_MEMSET = 0x34, /* fill R2 words at [R0] with R1 */
+    TRAP_MEMCMP = 0x35, /* compare R2 words at [R0] & [R1], R0 = -1, 0 or 1 */
+};
+
 #endif
@@ -1,10 +1,22 @@
 #include<stdint.h>
 #include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "read-image.h"
+#include "container.h"
 #include "core.h"
 #include "bit-utilities.h"
 
+/* symbols of every container loaded so far */
+static struct image_symbol {
+    uint16_t address;
+    char* name;
+}* symbols;
+static size_t symbol_count;
+
 /*
  * When Program is conveted to machine code the result is file containing array of instructions and data
  * this can be loaded by just copying the contents right into an address in memoery
@@ -25,17 +37,125 @@ void read_image_file(FILE* file) {
         ++p;
     }
 }
+
+/* [offset, offset + length) lies inside the file, written so that no sum can wrap */
+static uint16_t in_file(uint64_t offset, uint64_t length, size_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+static uint16_t container_valid(const uint8_t* file, size_t size) {
+    const struct container_header* header = (const void*)file;
+    if (header->version != CONTAINER_VERSION || header->endian != CONTAINER_ENDIAN) {
+        return 0;
+    }
+    /* counts are 32bit so the lengths below can't overflow 64bit */
+    if (!in_file(sizeof(*header), (uint64_t)header->section_count * sizeof(struct container_section), size) ||
+        !in_file(header->symbol_offset, (uint64_t)header->symbol_count * sizeof(struct container_symbol), size) ||
+        !in_file(header->strings_offset, header->strings_size, size) || header->symbol_offset % sizeof(struct container_symbol)) {
+        return 0;
+    }
+    /* names block ends with 0 so no name runs past it */
+    if (header->strings_size && file[header->strings_offset + header->strings_size - 1]) {
+        return 0;
+    }
+    const struct container_section* sections = (const void*)(file + sizeof(*header));
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        if (sections[i].origin + (uint64_t)sections[i].words > MEMORY_MAX) {
+            return 0;
+        }
+        if (!(sections[i].flags & SECTION_ZERO) &&
+            (sections[i].offset % CONTAINER_ALIGN || !in_file(sections[i].offset, (uint64_t)sections[i].words * sizeof(uint16_t), size))) {
+            return 0;
+        }
+    }
+    const struct container_symbol* table = (const void*)(file + header->symbol_offset);
+    for (uint32_t i = 0; i < header->symbol_count; i++) {
+        if (table[i].name >= header->strings_size) {
+            return 0;
+        }
+    }
+    struct container_header zeroed = *header;
+    zeroed.hash = 0;
+    uint64_t hash = container_hash(CONTAINER_HASH_SEED, &zeroed, sizeof(zeroed));
+    hash = container_hash(hash, file + sizeof(zeroed), size - sizeof(zeroed));
+    return hash == header->hash;
+}
+
 /*
- * Function to read image file
+ * Load container image, see container.h
+ * file is mapped instead of read so pages of zero padding are never touched,
+ * nothing is loaded unless the whole file passes the checks
+ */
+static uint16_t read_container(FILE* file) {
+    struct stat st;
+    if (fstat(fileno(file), &st) < 0 || (size_t)st.st_size < sizeof(struct container_header)) {
+        return 0;
+    }
+    size_t size = st.st_size;
+    uint8_t* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    if (!container_valid(map, size)) {
+        munmap(map, size);
+        return 0;
+    }
+    const struct container_header* header = (const void*)map;
+    const struct container_section* sections = (const void*)(map + sizeof(*header));
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        if (sections[i].flags & SECTION_ZERO) {
+            memset(memory + sections[i].origin, 0, sections[i].words * sizeof(uint16_t));
+        } else {
+            memcpy(memory + sections[i].origin, map + sections[i].offset, sections[i].words * sizeof(uint16_t));
+        }
+    }
+    const struct container_symbol* table = (const void*)(map + header->symbol_offset);
+    const char* names = (const char*)map + header->strings_offset;
+    struct image_symbol* grown = realloc(symbols, (symbol_count + header->symbol_count) * sizeof(*symbols));
+    if (grown) {
+        symbols = grown;
+        for (uint32_t i = 0; i < header->symbol_count; i++) {
+            symbols[symbol_count].address = table[i].address;
+            symbols[symbol_count].name = strdup(names + table[i].name);
+            symbol_count += symbols[symbol_count].name != NULL;
+        }
+    }
+    munmap(map, size);
+    return 1;
+}
+
+/*
+ * Function to read image file, container images are told apart from .obj by their magic
  */
 uint16_t read_image(const char* image_path) {
     FILE* file = fopen(image_path, "rb");
     if (!file) {
         return 0;
     }
-    read_image_file(file);
+    char magic[sizeof(CONTAINER_MAGIC) - 1];
+    uint16_t loaded = 1;
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, CONTAINER_MAGIC, sizeof(magic)) == 0) {
+        loaded = read_container(file);
+    } else {
+        rewind(file);
+        read_image_file(file);
+    }
     fclose(file);
-    return 1;
+    return loaded;
+}
+
+const char* image_symbol(uint16_t address, uint16_t* offset) {
+    struct image_symbol* best = NULL;
+    for (size_t i = 0; i < symbol_count; i++) {
+        if (symbols[i].address <= address && (!best || symbols[i].address > best->address)) {
+            best = &symbols[i];
+        }
+    }
+    if (!best) {
+        return NULL;
+    }
+    *offset = address - best->address;
+    return best->name;
 }
 
 
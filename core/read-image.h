@@ -3,9 +3,18 @@
 #include<stdint.h>
 #include<stdio.h>
 
+/*
+ * Load .obj or container image (see container.h) into memory, returns 0 when file can't be read or container is invalid
+ */
 uint16_t read_image(const char* filepath);
 void read_image_file(FILE* file);
 
+/*
+ * Nearest symbol at or below address from loaded container images, NULL when there is none
+ * offset is set to distance of address from the symbol
+ */
+const char* image_symbol(uint16_t address, uint16_t* offset);
+
 #endif
 
 
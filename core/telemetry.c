@@ -0,0 +1,88 @@
+#include<fcntl.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<unistd.h>
+#include <sys/mman.h>
+
+#include "telemetry.h"
+
+static struct telemetry private_telemetry;
+struct telemetry* telemetry = &private_telemetry;
+
+static char telemetry_path[64];
+static uint64_t rate_ns;
+static uint64_t rate_instructions;
+static uint32_t publish_count;
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+uint16_t telemetry_open(const char* image) {
+    snprintf(telemetry_path, sizeof(telemetry_path), TELEMETRY_DIR "/" TELEMETRY_PREFIX "%d", (int)getpid());
+    int fd = open(telemetry_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+    if (ftruncate(fd, sizeof(struct telemetry)) < 0) {
+        close(fd);
+        unlink(telemetry_path);
+        return 0;
+    }
+    void* map = mmap(NULL, sizeof(struct telemetry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        unlink(telemetry_path);
+        return 0;
+    }
+    struct telemetry* shared = map;
+    memcpy(shared, &private_telemetry, sizeof(struct telemetry));
+    shared->version = TELEMETRY_VERSION;
+    shared->pid = getpid();
+    strncpy(shared->image, image, sizeof(shared->image) - 1);
+    rate_ns = now_ns();
+    atomic_store_explicit(&shared->updated_ns, rate_ns, memory_order_relaxed);
+    atomic_store_explicit(&shared->magic, TELEMETRY_MAGIC, memory_order_release);
+    telemetry = shared;
+    atexit(telemetry_close);
+    return 1;
+}
+
+static void publish_clock(uint64_t instructions) {
+    uint64_t now = now_ns();
+    if (now - rate_ns >= TELEMETRY_RATE_NS) {
+        uint64_t rate = (instructions - rate_instructions) * 1000000000 / (now - rate_ns);
+        atomic_store_explicit(&telemetry->instructions_per_second, rate, memory_order_relaxed);
+        rate_ns = now;
+        rate_instructions = instructions;
+    }
+    atomic_store_explicit(&telemetry->updated_ns, now, memory_order_relaxed);
+}
+
+void telemetry_publish(uint64_t instructions, uint16_t pc) {
+    atomic_store_explicit(&telemetry->instructions, instructions, memory_order_relaxed);
+    atomic_store_explicit(&telemetry->pc, pc, memory_order_relaxed);
+    /* reading the clock costs more than the batch itself, only do it every TELEMETRY_CLOCK_EVERY publishes */
+    if (++publish_count % TELEMETRY_CLOCK_EVERY) {
+        return;
+    }
+    publish_clock(instructions);
+}
+
+void telemetry_publish_idle(uint64_t instructions, uint16_t pc) {
+    atomic_store_explicit(&telemetry->instructions, instructions, memory_order_relaxed);
+    atomic_store_explicit(&telemetry->pc, pc, memory_order_relaxed);
+    publish_clock(instructions);
+}
+
+void telemetry_close() {
+    if (telemetry != &private_telemetry) {
+        munmap(telemetry, sizeof(struct telemetry));
+        unlink(telemetry_path);
+        telemetry = &private_telemetry;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef _H_TELEMETRY_
+#define _H_TELEMETRY_
+#include<stdatomic.h>
+#include<stdint.h>
+
+/*
+ * Telemetry
+ * Running vm publishes its counters in a shared memory file TELEMETRY_DIR/lc3-<pid> so tools like lc3-top can sample
+ * many vms without pausing them. vm is the only writer, counters are monotonic & updated with relaxed atomics,
+ * a reader may see counters from slightly different moments but never a torn value.
+ *
+ * magic is stored last with release ordering, reader must ignore the file until magic matches
+ */
+#define TELEMETRY_DIR "/dev/shm"
+#define TELEMETRY_PREFIX "lc3-"
+#define TELEMETRY_MAGIC 0x4C433354 /* LC3T */
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RATE_NS 250000000
+#define TELEMETRY_CLOCK_EVERY 64
+
+struct telemetry {
+    _Atomic uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    uint32_t reserved;
+    char image[64];
+
+    _Atomic uint64_t instructions;            /* instructions retired, interpreted & by native loops */
+    _Atomic uint64_t instructions_per_second; /* rate over the last publish window */
+    _Atomic uint64_t updated_ns;              /* CLOCK_MONOTONIC time of last publish */
+    _Atomic uint64_t pc;                      /* PC at last publish */
+    _Atomic uint64_t kbsr_polls;              /* guest reads of KBSR */
+    _Atomic uint64_t bytes_in;                /* characters read from keyboard */
+    _Atomic uint64_t bytes_out;               /* characters written to display */
+    _Atomic uint64_t traps[256];              /* TRAP instructions by vector */
+};
+
+/*
+ * Counters of this vm, points to private storage until telemetry_open maps the shared file so updating is always safe
+ */
+extern struct telemetry* telemetry;
+
+/* single writer increment, plain load & store without a locked instruction */
+static inline void telemetry_add(_Atomic uint64_t* counter, uint64_t n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/*
+ * Create & map the shared file, it is removed again at exit. returns 0 if it can't be created, counters stay private then
+ */
+uint16_t telemetry_open(const char* image);
+
+/*
+ * Publish instruction count & PC, called by main loop once per batch of instructions
+ * clock is read every TELEMETRY_CLOCK_EVERY publishes, instructions per second is recomputed then
+ * if at least TELEMETRY_RATE_NS passed since the last time
+ */
+void telemetry_publish(uint64_t instructions, uint16_t pc);
+
+/* same as telemetry_publish but always reads the clock, for a vm about to sleep so readers see where it stopped */
+void telemetry_publish_idle(uint64_t instructions, uint16_t pc);
+
+void telemetry_close();
+
+#endif
@@ -0,0 +1,316 @@
+#include "idiom.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "./core/bit-utilities.h"
+#include "./core/core.h"
+#include "./core/opcode.h"
+
+uint8_t idiom_map[MEMORY_MAX];
+uint64_t idiom_retired;
+
+/* registers & offsets of a matched loop, meaning of each slot is given per idiom */
+struct loop {
+    uint16_t r[5];
+    uint16_t offset[2];
+    uint16_t exit;
+};
+
+/* ADD DR, SR1, SR2 */
+static uint16_t is_add_reg(uint16_t instr, uint16_t* dr, uint16_t* sr1, uint16_t* sr2) {
+    if ((instr >> 12) != OP_ADD || (instr & 0x38)) {
+        return 0;
+    }
+    *dr = (instr >> 9) & 0x7;
+    *sr1 = (instr >> 6) & 0x7;
+    *sr2 = instr & 0x7;
+    return 1;
+}
+
+/* ADD R, R, #imm with the same source & destination */
+static uint16_t is_add_imm(uint16_t instr, uint16_t* r, uint16_t imm) {
+    if ((instr >> 12) != OP_ADD || !(instr & 0x20) || (instr & 0x1F) != (imm & 0x1F)) {
+        return 0;
+    }
+    *r = (instr >> 9) & 0x7;
+    return ((instr >> 6) & 0x7) == *r;
+}
+
+/* BR with exactly given nzp bits & offset */
+static uint16_t is_branch(uint16_t instr, uint16_t nzp, uint16_t offset) {
+    return (instr >> 12) == OP_BR && ((instr >> 9) & 0x7) == nzp && (instr & 0x1FF) == (offset & 0x1FF);
+}
+
+static uint16_t distinct(const uint16_t* r, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (r[i] == r[j]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* whether [a, a + a_count) & [b, b + b_count) share a word, both taken modulo address space */
+static uint16_t overlaps(uint16_t a, uint16_t a_count, uint16_t b, uint16_t b_count) {
+    return (uint16_t)(b - a) < a_count || (uint16_t)(a - b) < b_count;
+}
+
+/* ADD Ra, Ra, Rb or ADD Ra, Rb, Ra, sets a = Ra & b = Rb */
+static uint16_t is_accumulate(uint16_t instr, uint16_t* a, uint16_t* b) {
+    uint16_t sr1, sr2;
+    if (!is_add_reg(instr, a, &sr1, &sr2)) {
+        return 0;
+    }
+    *b = sr1 == *a ? sr2 : sr1;
+    return sr1 == *a || sr2 == *a;
+}
+
+/* r = {Ra, Rb, Rc} */
+static uint16_t match_mul_add(uint16_t a, struct loop* l) {
+    return is_accumulate(memory[a], &l->r[0], &l->r[1])
+        && is_add_imm(memory[(uint16_t)(a + 1)], &l->r[2], 0xFFFF)
+        && is_branch(memory[(uint16_t)(a + 2)], FL_POS, -3)
+        && distinct(l->r, 3);
+}
+
+/* r = {Ra, Rm, Rb, Rk, Rt} */
+static uint16_t match_mul_shift(uint16_t a, struct loop* l) {
+    uint16_t instr = memory[a];
+    uint16_t sr1, sr2, dr;
+    if ((instr >> 12) != OP_AND || (instr & 0x38)) {
+        return 0;
+    }
+    l->r[4] = (instr >> 9) & 0x7;
+    l->r[2] = (instr >> 6) & 0x7;
+    l->r[3] = instr & 0x7;
+    return is_branch(memory[(uint16_t)(a + 1)], FL_ZRO, 1)
+        && is_accumulate(memory[(uint16_t)(a + 2)], &l->r[0], &l->r[1])
+        && is_add_reg(memory[(uint16_t)(a + 3)], &dr, &sr1, &sr2) && dr == l->r[1] && sr1 == dr && sr2 == dr
+        && is_add_reg(memory[(uint16_t)(a + 4)], &dr, &sr1, &sr2) && dr == l->r[3] && sr1 == dr && sr2 == dr
+        && is_branch(memory[(uint16_t)(a + 5)], FL_NEG | FL_POS, -6)
+        && distinct(l->r, 5);
+}
+
+/* r = {Rn, Rm, Rq} */
+static uint16_t match_div(uint16_t a, struct loop* l) {
+    uint16_t exit = memory[(uint16_t)(a + 1)];
+    if ((exit >> 12) != OP_BR || ((exit >> 9) & 0x7) != FL_NEG) {
+        return 0;
+    }
+    l->exit = a + 2 + sign_extend(exit & 0x1FF, 9);
+    return is_accumulate(memory[a], &l->r[0], &l->r[1])
+        && is_add_imm(memory[(uint16_t)(a + 2)], &l->r[2], 1)
+        && is_branch(memory[(uint16_t)(a + 3)], FL_NEG | FL_ZRO | FL_POS, -4)
+        && distinct(l->r, 3);
+}
+
+/* r = {Rt, Rs, Rd, Rc}, offset = {o1, o2} */
+static uint16_t match_copy(uint16_t a, struct loop* l) {
+    uint16_t ldr = memory[a];
+    uint16_t str = memory[(uint16_t)(a + 1)];
+    if ((ldr >> 12) != OP_LDR || (str >> 12) != OP_STR || ((ldr >> 9) & 0x7) != ((str >> 9) & 0x7)) {
+        return 0;
+    }
+    l->r[0] = (ldr >> 9) & 0x7;
+    l->r[1] = (ldr >> 6) & 0x7;
+    l->r[2] = (str >> 6) & 0x7;
+    l->offset[0] = sign_extend(ldr & 0x3F, 6);
+    l->offset[1] = sign_extend(str & 0x3F, 6);
+    uint16_t first, second;
+    if (!is_add_imm(memory[(uint16_t)(a + 2)], &first, 1) || !is_add_imm(memory[(uint16_t)(a + 3)], &second, 1)) {
+        return 0;
+    }
+    if (!((first == l->r[1] && second == l->r[2]) || (first == l->r[2] && second == l->r[1]))) {
+        return 0;
+    }
+    return is_add_imm(memory[(uint16_t)(a + 4)], &l->r[3], 0xFFFF)
+        && is_branch(memory[(uint16_t)(a + 5)], FL_POS, -6)
+        && distinct(l->r, 4);
+}
+
+/* r = {Rv, Rd, Rc}, offset = {o} */
+static uint16_t match_fill(uint16_t a, struct loop* l) {
+    uint16_t str = memory[a];
+    uint16_t rd;
+    if ((str >> 12) != OP_STR) {
+        return 0;
+    }
+    l->r[0] = (str >> 9) & 0x7;
+    l->r[1] = (str >> 6) & 0x7;
+    l->offset[0] = sign_extend(str & 0x3F, 6);
+    return is_add_imm(memory[(uint16_t)(a + 1)], &rd, 1) && rd == l->r[1]
+        && is_add_imm(memory[(uint16_t)(a + 2)], &l->r[2], 0xFFFF)
+        && is_branch(memory[(uint16_t)(a + 3)], FL_POS, -4)
+        && distinct(l->r, 3);
+}
+
+static uint8_t idiom_match(uint16_t a, struct loop* l) {
+    if (match_mul_add(a, l)) {
+        return IDIOM_MUL_ADD;
+    }
+    if (match_mul_shift(a, l)) {
+        return IDIOM_MUL_SHIFT;
+    }
+    if (match_div(a, l)) {
+        return IDIOM_DIV;
+    }
+    if (match_copy(a, l)) {
+        return IDIOM_COPY;
+    }
+    if (match_fill(a, l)) {
+        return IDIOM_FILL;
+    }
+    return IDIOM_NONE;
+}
+
+void idiom_scan() {
+    struct loop l;
+    for (uint32_t a = 0; a < MEMORY_MAX; a++) {
+        idiom_map[a] = idiom_match(a, &l);
+    }
+}
+
+void idiom_scan_heads(const uint16_t* heads, uint32_t count) {
+    struct loop l;
+    memset(idiom_map, 0, sizeof(idiom_map));
+    for (uint32_t i = 0; i < count; i++) {
+        idiom_map[heads[i]] = idiom_match(heads[i], &l);
+    }
+}
+
+/*
+ * Each run_* is entered at loop head after at least one iteration was interpreted
+ * it checks the runtime preconditions under which the closed form is exact & returns 0 otherwise
+ */
+
+static uint16_t run_mul_add(uint16_t a, const struct loop* l) {
+    int16_t count = reg[l->r[2]];
+    if (count <= 0) {
+        return 0;
+    }
+    reg[l->r[0]] += (uint16_t)(reg[l->r[1]] * count);
+    reg[l->r[2]] = 0;
+    reg[R_COND] = FL_ZRO;
+    reg[R_PC] = a + 3;
+    idiom_retired += 3 * (uint64_t)count;
+    return 1;
+}
+
+static uint16_t run_mul_shift(uint16_t a, const struct loop* l) {
+    uint16_t acc = reg[l->r[0]];
+    uint16_t m = reg[l->r[1]];
+    uint16_t b = reg[l->r[2]];
+    uint16_t mask = reg[l->r[3]];
+    uint16_t t = reg[l->r[4]];
+    if (!mask) {
+        return 0;
+    }
+    /* mask doubles every iteration so this runs at most 16 times */
+    do {
+        t = b & mask;
+        if (t) {
+            acc += m;
+            idiom_retired += 1;
+        }
+        m += m;
+        mask += mask;
+        idiom_retired += 5;
+    } while (mask);
+    reg[l->r[0]] = acc;
+    reg[l->r[1]] = m;
+    reg[l->r[3]] = 0;
+    reg[l->r[4]] = t;
+    reg[R_COND] = FL_ZRO;
+    reg[R_PC] = a + 6;
+    return 1;
+}
+
+static uint16_t run_div(uint16_t a, const struct loop* l) {
+    int32_t n = (int16_t)reg[l->r[0]];
+    int32_t m = (int16_t)reg[l->r[1]];
+    if (n < 0 || m >= 0) {
+        return 0;
+    }
+    int32_t d = -m;
+    int32_t k = n / d;
+    reg[l->r[0]] = (uint16_t)(n - (k + 1) * d);
+    reg[l->r[2]] += (uint16_t)k;
+    reg[R_COND] = FL_NEG;
+    reg[R_PC] = l->exit;
+    idiom_retired += 4 * (uint64_t)k + 2;
+    return 1;
+}
+
+static uint16_t run_copy(uint16_t a, const struct loop* l) {
+    int16_t count = reg[l->r[3]];
+    uint16_t src = reg[l->r[1]] + l->offset[0];
+    uint16_t dst = reg[l->r[2]] + l->offset[1];
+    if (count <= 0 || !range_is_ram(src, count) || !range_is_ram(dst, count) || overlaps(dst, count, a, 6)) {
+        return 0;
+    }
+    if (dst > src && dst < src + count) {
+        /* destination starts inside source, guest loop replicates the words it already copied */
+        for (uint16_t i = 0; i < count; i++) {
+            memory[dst + i] = memory[src + i];
+        }
+    } else {
+        memmove(memory + dst, memory + src, count * sizeof(uint16_t));
+    }
+    memory_written(dst, count);
+    /* last word loaded is never overwritten after it was read */
+    reg[l->r[0]] = memory[src + count - 1];
+    reg[l->r[1]] += count;
+    reg[l->r[2]] += count;
+    reg[l->r[3]] = 0;
+    reg[R_COND] = FL_ZRO;
+    reg[R_PC] = a + 6;
+    idiom_retired += 6 * (uint64_t)count;
+    return 1;
+}
+
+static uint16_t run_fill(uint16_t a, const struct loop* l) {
+    int16_t count = reg[l->r[2]];
+    uint16_t dst = reg[l->r[1]] + l->offset[0];
+    if (count <= 0 || !range_is_ram(dst, count) || overlaps(dst, count, a, 4)) {
+        return 0;
+    }
+    uint16_t val = reg[l->r[0]];
+    for (uint16_t i = 0; i < count; i++) {
+        memory[dst + i] = val;
+    }
+    memory_written(dst, count);
+    reg[l->r[1]] += count;
+    reg[l->r[2]] = 0;
+    reg[R_COND] = FL_ZRO;
+    reg[R_PC] = a + 4;
+    idiom_retired += 4 * (uint64_t)count;
+    return 1;
+}
+
+uint16_t idiom_execute(uint16_t a) {
+    struct loop l;
+    switch (idiom_match(a, &l)) {
+        case IDIOM_MUL_ADD: {
+            return run_mul_add(a, &l);
+        }
+        case IDIOM_MUL_SHIFT: {
+            return run_mul_shift(a, &l);
+        }
+        case IDIOM_DIV: {
+            return run_div(a, &l);
+        }
+        case IDIOM_COPY: {
+            return run_copy(a, &l);
+        }
+        case IDIOM_FILL: {
+            return run_fill(a, &l);
+        }
+        default:
+            /* code changed since it was scanned */
+            idiom_map[a] = IDIOM_NONE;
+            return 0;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef _H_IDIOM_
+#define _H_IDIOM_
+
+#include<stdint.h>
+#include "./core/core.h"
+
+/*
+ * Idiom Recognition
+ * Loaded code is scanned for canonical LC-3 loops & their heads are marked in idiom_map.
+ * When a backward branch lands on a marked head, the loop is matched again against current memory & registers,
+ * if it still matches the remaining iterations are done natively leaving exactly the same registers, R_COND & memory
+ * as interpreting them would. If it doesn't match, interpretation just continues.
+ *
+ * Multiply (repeated addition)        Multiply (shift & add)
+ * LOOP ADD Ra, Ra, Rb                 LOOP AND Rt, Rb, Rk
+ *      ADD Rc, Rc, #-1                     BRz SKIP
+ *      BRp LOOP                            ADD Ra, Ra, Rm
+ *                                     SKIP ADD Rm, Rm, Rm
+ *                                          ADD Rk, Rk, Rk
+ *                                          BRnp LOOP
+ *
+ * Divide (repeated subtraction)       Copy                        Fill
+ * LOOP ADD Rn, Rn, Rm   ; Rm = -d     LOOP LDR Rt, Rs, #o1        LOOP STR Rv, Rd, #o
+ *      BRn DONE                            STR Rt, Rd, #o2             ADD Rd, Rd, #1
+ *      ADD Rq, Rq, #1                      ADD Rs, Rs, #1              ADD Rc, Rc, #-1
+ *      BRnzp LOOP                          ADD Rd, Rd, #1              BRp LOOP
+ *                                          ADD Rc, Rc, #-1
+ *                                          BRp LOOP
+ * registers in a loop must be distinct, the two pointer increments of copy can be in either order
+ */
+enum {
+    IDIOM_NONE = 0,
+    IDIOM_MUL_ADD,
+    IDIOM_MUL_SHIFT,
+    IDIOM_DIV,
+    IDIOM_COPY,
+    IDIOM_FILL,
+};
+
+/* idiom kind of the loop starting at address, IDIOM_NONE for everything else */
+extern uint8_t idiom_map[MEMORY_MAX];
+
+/* guest instructions retired by native loops, main loop only counts the ones it interprets */
+extern uint64_t idiom_retired;
+
+/* scan whole memory for loop heads, called once after images are loaded */
+void idiom_scan();
+
+/* same as idiom_scan but only looks at given addresses, backward branch targets from image analysis (see analysis.h) */
+void idiom_scan_heads(const uint16_t* heads, uint32_t count);
+
+/*
+ * Run rest of the loop starting at address natively, called when a backward branch lands on a marked head
+ * returns 0 when loop doesn't match anymore & has to be interpreted
+ */
+uint16_t idiom_execute(uint16_t address);
+
+#endif
@@ -4,7 +4,11 @@
 #include <stdio.h>
 
 #include "./core/bit-utilities.h"
+#include "./core/console.h"
 #include "./core/core.h"
+#include "./core/interrupt.h"
+#include "./core/telemetry.h"
+#include "idiom.h"
 
 uint16_t op_add(uint16_t instr) {
     
@@ -55,6 +59,13 @@ uint16_t op_branch(uint16_t instr) {
     uint16_t cond_flag = (instr >> 9) & 0x7;
     if (cond_flag & reg[R_COND]) {
         reg[R_PC] += pc_offset;
+        /* branch to itself can only be left by an interrupt, sleep instead of spinning */
+        if (pc_offset == 0xFFFF) {
+            device_wait();
+        } else if ((pc_offset >> 15) && idiom_map[reg[R_PC]]) {
+            /* backward branch to a recognised loop head, rest of the loop may run natively */
+            idiom_execute(reg[R_PC]);
+        }
     }
     return 1;
 }
@@ -142,58 +153,60 @@ uint16_t op_store_base_offset(uint16_t instr) {
     return 1;
 }
 
+uint16_t op_return_from_interrupt(uint16_t instr) {
+    return interrupt_return();
+}
+
 /* trap instructions */
 
+static trap_handler trap_table[256];
+
+void trap_register(uint8_t vector, trap_handler handler) {
+    trap_table[vector] = handler;
+}
+
+void trap_setup() {
+    trap_register(TRAP_GETC, op_trap_getc);
+    trap_register(TRAP_OUT, op_trap_out);
+    trap_register(TRAP_PUTS, op_trap_puts);
+    trap_register(TRAP_IN, op_trap_in);
+    trap_register(TRAP_PUTSP, op_trap_putsp);
+    trap_register(TRAP_HALT, op_trap_halt);
+}
+
 uint16_t op_trap(uint16_t instr) {
-    switch (instr & 0xFF) {
-        case TRAP_GETC: {
-            return op_trap_getc(instr);
-        }
-        case TRAP_OUT: {
-            return op_trap_out(instr);
-        }
-        case TRAP_PUTS: {
-            return op_trap_puts(instr);
-        }
-        case TRAP_IN: {
-            return op_trap_in(instr);
-        }
-        case TRAP_PUTSP: {
-            return op_trap_putsp(instr);
-        }
-        case TRAP_HALT: {
-            return op_trap_halt(instr);
-        }
-        default:
-            return 0;
+    telemetry_add(&telemetry->traps[instr & 0xFF], 1);
+    trap_handler handler = trap_table[instr & 0xFF];
+    if (!handler) {
+        return 0;
     }
-    return 1;
+    return handler(instr);
 }
 
 uint16_t op_trap_getc(uint16_t instr) {
-    reg[R_R0] = (uint16_t)getchar();
+    reg[R_R0] = (uint16_t)console_getc();
     return 1;
 }
 
 uint16_t op_trap_out(uint16_t instr) {
-    putc((char)(reg[R_R0]), stdout);
-    fflush(stdout);
+    console_putc((char)(reg[R_R0]));
+    console_flush();
     return 1;
 }
 
 uint16_t op_trap_puts(uint16_t instr) {
     uint16_t* c = memory + reg[R_R0];
     while (*c) {
-        putc((char)*c, stdout);
+        console_putc((char)*c);
         c++;
     }
-    fflush(stdout);
+    console_flush();
     return 1;
 }
 
 uint16_t op_trap_in(uint16_t instr) {
-    reg[R_R0] = (uint16_t) getchar();
-    fflush(stdout);
+    reg[R_R0] = (uint16_t) console_getc();
+    console_flush();
     return 1;
 }
 
@@ -201,17 +214,18 @@ uint16_t op_trap_putsp(uint16_t instr) {
     uint16_t* c = memory + reg[R_R0];
     while (*c) {
         char char1 = (*c) & 0xFF;
-        putc((char)(char1), stdout);
+        console_putc((char)(char1));
         char char2 = (*c) >> 8;
         if (char2)
-            putc((char)((*c) >> 8), stdout);
+            console_putc((char)((*c) >> 8));
         ++c;
     }
-    fflush(stdout);
+    console_flush();
     return 1;
 }
 
 uint16_t op_trap_halt(uint16_t instr) {
+    console_sync();
     puts("HALT");
     fflush(stdout);
     return 0;
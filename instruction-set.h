@@ -193,6 +193,16 @@ uint16_t op_store_indirect(uint16_t instruction);
 */
 uint16_t op_store_base_offset(uint16_t instruction);
 
+/* Return from interrupt
+* RTI
+* Encoding
+* +-----------------------------+
+* | 1000 | 0000 0000 0000       |
+* +-----------------------------+
+* PC & PSR are popped from supervisor stack, if PSR returns to user mode R6 is switched back to user stack
+* in user mode this causes privilege mode exception
+*/
+uint16_t op_return_from_interrupt(uint16_t instruction);
 
 /* trap instructions */
 /*
@@ -206,6 +216,19 @@ uint16_t op_store_base_offset(uint16_t instruction);
 
 uint16_t op_trap(uint16_t instruction);
 
+/*
+* Trap Table
+* op_trap dispatches through table of 256 handlers indexed by trapvect8, handler returns 0 to stop the machine
+* vector without handler stops the machine same as HALT
+*/
+typedef uint16_t (*trap_handler)(uint16_t instruction);
+
+/* register handler for trap vector, NULL removes it */
+void trap_register(uint8_t vector, trap_handler handler);
+
+/* register standard trap routines GETC, OUT, PUTS, IN, PUTSP & HALT */
+void trap_setup();
+
 /*
  * Reading Single character from keyboard, the character is not echoed to console
  * The ASCII code is copied into R0. the high eight bits of R0 are also cleared.
@@ -0,0 +1,587 @@
+#include "lanes.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./core/bit-utilities.h"
+#include "./core/core.h"
+#include "./core/opcode.h"
+
+/* one 16bit word per lane, 256bit for 16 lanes */
+typedef uint16_t lane_vec __attribute__((vector_size(LANES * sizeof(uint16_t))));
+typedef int16_t lane_svec __attribute__((vector_size(LANES * sizeof(int16_t))));
+
+/*
+ * Scheduler loop is compiled for AVX2 & baseline, loader picks one for the host
+ * everything taking vectors is inlined into it, vectors never cross a call between the two ABIs
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LANES_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define LANES_KERNEL
+#endif
+#define LANES_INLINE static inline __attribute__((always_inline))
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+/* a lane that didn't run for this many steps is scheduled next even if its PC isn't the lowest */
+#define STARVE_LIMIT 64
+
+enum {
+    LANE_RUNNING = 0,
+    LANE_HALTED,
+    LANE_FAULT,
+};
+
+struct lane_io {
+    uint8_t* input;
+    size_t length;
+    size_t position;
+    FILE* output;
+    uint64_t bytes_out;
+};
+
+static struct {
+    lane_vec reg[R_COUNT];
+    lane_vec active; /* 0xFFFF for running lanes */
+    int lead;        /* some running lane, -1 once all stopped */
+    lane_vec retired; /* recent instruction count, folded into total before it wraps */
+    uint64_t total[LANES];
+    lane_vec* memory;
+    struct lane_io io[LANES];
+    int status[LANES];
+    lane_vec waited; /* steps since lane last ran, saturates */
+} lanes;
+
+LANES_INLINE lane_vec broadcast(uint16_t v) {
+    return (lane_vec){0} + v;
+}
+
+LANES_INLINE lane_vec blend(lane_vec mask, lane_vec a, lane_vec b) {
+    return (a & mask) | (b & ~mask);
+}
+
+LANES_INLINE int any(lane_vec v) {
+    uint64_t words[sizeof(lane_vec) / sizeof(uint64_t)];
+    memcpy(words, &v, sizeof(v));
+    uint64_t all = 0;
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        all |= words[i];
+    }
+    return all != 0;
+}
+
+/* every lane selected by mask holds value */
+LANES_INLINE int uniform(lane_vec v, lane_vec mask, uint16_t value) {
+    return !any((lane_vec)(v != value) & mask);
+}
+
+/* same as update_flags for all lanes */
+LANES_INLINE lane_vec flags_of(lane_vec v) {
+    lane_vec zero = (lane_vec)(v == 0);
+    lane_vec neg = (lane_vec)((lane_svec)v < 0);
+    return (zero & FL_ZRO) | (neg & FL_NEG) | (~(zero | neg) & FL_POS);
+}
+
+/* mask lanes are 0xFFFF, subtracting adds one */
+LANES_INLINE void retire(lane_vec mask) {
+    lanes.retired -= mask;
+}
+
+static void fold_retired() {
+    for (int l = 0; l < LANES; l++) {
+        lanes.total[l] += lanes.retired[l];
+        lanes.retired[l] = 0;
+    }
+}
+
+/* Single lane */
+
+static void lane_stop(int l, int status) {
+    lanes.status[l] = status;
+    lanes.active[l] = 0;
+    if (lanes.lead == l) {
+        lanes.lead = -1;
+        for (int i = 0; i < LANES; i++) {
+            if (lanes.active[i]) {
+                lanes.lead = i;
+                break;
+            }
+        }
+    }
+}
+
+static void lane_putc(int l, uint16_t c) {
+    struct lane_io* io = &lanes.io[l];
+    io->bytes_out++;
+    if (io->output) {
+        putc((char)c, io->output);
+    }
+}
+
+static int lane_getc(int l) {
+    struct lane_io* io = &lanes.io[l];
+    if (io->position < io->length) {
+        return io->input[io->position++];
+    }
+    return EOF;
+}
+
+/* guest used a device lanes don't model, lane stops instead of silently behaving unlike the vm */
+static void lane_unsupported(int l, const char* what) {
+    fprintf(stderr, "lane %d: %s is not supported in lanes\n", l, what);
+    lane_stop(l, LANE_FAULT);
+}
+
+/* keyboard reads lane input, display writes lane output, same registers as device.c */
+static uint16_t lane_read(int l, uint16_t address) {
+    if (!(page_attr[address >> PAGE_SHIFT] & PAGE_READ_HOOK)) {
+        return lanes.memory[address][l];
+    }
+    switch (address) {
+        case MR_KBSR: {
+            if (!(lanes.memory[MR_KBSR][l] & KBSR_READY)) {
+                int c = lane_getc(l);
+                if (c != EOF) {
+                    lanes.memory[MR_KBSR][l] |= KBSR_READY;
+                    lanes.memory[MR_KBDR][l] = c;
+                }
+            }
+            return lanes.memory[MR_KBSR][l];
+        }
+        case MR_KBDR: {
+            lanes.memory[MR_KBSR][l] &= ~KBSR_READY;
+            return lanes.memory[MR_KBDR][l];
+        }
+        case MR_DSR: {
+            return (1 << 15);
+        }
+        case MR_TMR: {
+            lane_unsupported(l, "timer");
+            return 0;
+        }
+        case MR_PSR: {
+            lane_unsupported(l, "PSR");
+            return 0;
+        }
+        default:
+            return lanes.memory[address][l];
+    }
+}
+
+static void lane_write(int l, uint16_t address, uint16_t val) {
+    if (!(page_attr[address >> PAGE_SHIFT] & PAGE_WRITE_HOOK)) {
+        lanes.memory[address][l] = val;
+        return;
+    }
+    switch (address) {
+        case MR_KBSR: {
+            /* only interrupt enable is writable, same as device.c */
+            if (val & KBSR_IE) {
+                lane_unsupported(l, "keyboard interrupt");
+            }
+            lanes.memory[MR_KBSR][l] &= KBSR_READY;
+            break;
+        }
+        case MR_DDR: {
+            lanes.memory[address][l] = val;
+            lane_putc(l, val);
+            break;
+        }
+        case MR_MCR: {
+            lanes.memory[address][l] = val;
+            if (!(val >> 15)) {
+                lane_stop(l, LANE_HALTED);
+            }
+            break;
+        }
+        case MR_TMR:
+        case MR_TMI: {
+            lane_unsupported(l, "timer");
+            break;
+        }
+        case MR_PSR: {
+            lane_unsupported(l, "PSR");
+            break;
+        }
+        default:
+            lanes.memory[address][l] = val;
+            break;
+    }
+}
+
+static void lane_trap(int l, uint16_t* r, uint16_t vector) {
+    switch (vector) {
+        case TRAP_GETC:
+        case TRAP_IN: {
+            r[R_R0] = (uint16_t)lane_getc(l);
+            break;
+        }
+        case TRAP_OUT: {
+            lane_putc(l, r[R_R0]);
+            break;
+        }
+        case TRAP_PUTS: {
+            for (uint16_t a = r[R_R0]; lanes.memory[a][l]; a++) {
+                lane_putc(l, lanes.memory[a][l]);
+            }
+            break;
+        }
+        case TRAP_PUTSP: {
+            for (uint16_t a = r[R_R0]; lanes.memory[a][l]; a++) {
+                lane_putc(l, lanes.memory[a][l] & 0xFF);
+                if (lanes.memory[a][l] >> 8) {
+                    lane_putc(l, lanes.memory[a][l] >> 8);
+                }
+            }
+            break;
+        }
+        default: {
+            /* HALT & unknown vectors stop the machine, same as op_trap */
+            if (vector == TRAP_HALT) {
+                for (const char* s = "HALT\n"; *s; s++) {
+                    lane_putc(l, *s);
+                }
+            }
+            lane_stop(l, LANE_HALTED);
+            break;
+        }
+    }
+}
+
+/*
+ * Scalar interpreter for one lane, used when lanes at the same PC can't share a vector operation
+ * semantics follow instruction-set.c exactly, including JSRR reading its base register after R7 is set
+ */
+static void lane_execute(int l) {
+    uint16_t r[R_COUNT];
+    for (int i = 0; i < R_COUNT; i++) {
+        r[i] = lanes.reg[i][l];
+    }
+    uint16_t instr = lane_read(l, r[R_PC]++);
+    uint16_t dr = (instr >> 9) & 0x7;
+    uint16_t sr = (instr >> 6) & 0x7;
+    uint16_t offset9 = sign_extend(instr & 0x1FF, 9);
+    uint16_t offset6 = sign_extend(instr & 0x3F, 6);
+    int flags = 1;
+    switch (instr >> 12) {
+        case OP_ADD: {
+            r[dr] = r[sr] + ((instr >> 5) & 0x1 ? sign_extend(instr & 0x1F, 5) : r[instr & 0x7]);
+            break;
+        }
+        case OP_AND: {
+            r[dr] = r[sr] & ((instr >> 5) & 0x1 ? sign_extend(instr & 0x1F, 5) : r[instr & 0x7]);
+            break;
+        }
+        case OP_NOT: {
+            r[dr] = ~r[sr];
+            break;
+        }
+        case OP_LD: {
+            r[dr] = lane_read(l, r[R_PC] + offset9);
+            break;
+        }
+        case OP_LDI: {
+            r[dr] = lane_read(l, lane_read(l, r[R_PC] + offset9));
+            break;
+        }
+        case OP_LDR: {
+            r[dr] = lane_read(l, r[sr] + offset6);
+            break;
+        }
+        case OP_LEA: {
+            r[dr] = r[R_PC] + offset9;
+            break;
+        }
+        default:
+            flags = 0;
+            break;
+    }
+    switch (instr >> 12) {
+        case OP_BR: {
+            if (dr & r[R_COND]) {
+                r[R_PC] += offset9;
+            }
+            break;
+        }
+        case OP_ST: {
+            lane_write(l, r[R_PC] + offset9, r[dr]);
+            break;
+        }
+        case OP_STI: {
+            lane_write(l, lane_read(l, r[R_PC] + offset9), r[dr]);
+            break;
+        }
+        case OP_STR: {
+            lane_write(l, r[sr] + offset6, r[dr]);
+            break;
+        }
+        case OP_JMP: {
+            r[R_PC] = r[sr];
+            break;
+        }
+        case OP_JSR: {
+            r[R_R7] = r[R_PC];
+            r[R_PC] = (instr >> 11) & 0x1 ? r[R_PC] + sign_extend(instr & 0x7FF, 11) : r[sr];
+            break;
+        }
+        case OP_TRAP: {
+            lane_trap(l, r, instr & 0xFF);
+            break;
+        }
+        case OP_RTI:
+        case OP_RES: {
+            lane_stop(l, LANE_FAULT);
+            break;
+        }
+    }
+    if (flags) {
+        r[R_COND] = r[dr] == 0 ? FL_ZRO : (r[dr] >> 15 ? FL_NEG : FL_POS);
+    }
+    for (int i = 0; i < R_COUNT; i++) {
+        lanes.reg[i][l] = r[i];
+    }
+    lanes.retired[l]++;
+}
+
+LANES_INLINE void execute_each(lane_vec mask) {
+    for (int l = 0; l < LANES; l++) {
+        if (mask[l]) {
+            lane_execute(l);
+        }
+    }
+}
+
+/* Lane group */
+
+/*
+ * Execute instruction at pc for every lane in mask, all of them are at pc & lane `lead` is one of them
+ * returns 0 when the group can't share one vector operation & has to run lane by lane
+ */
+LANES_INLINE int step_group(uint16_t pc, lane_vec mask, int lead) {
+    lane_vec* R = lanes.reg;
+    if (page_attr[pc >> PAGE_SHIFT] & PAGE_READ_HOOK) {
+        return 0;
+    }
+    uint16_t instr = lanes.memory[pc][lead];
+    if (!uniform(lanes.memory[pc], mask, instr)) {
+        return 0;
+    }
+    uint16_t next = pc + 1;
+    uint16_t dr = (instr >> 9) & 0x7;
+    uint16_t sr = (instr >> 6) & 0x7;
+    uint16_t offset9 = sign_extend(instr & 0x1FF, 9);
+    uint16_t offset6 = sign_extend(instr & 0x3F, 6);
+    lane_vec result;
+    switch (instr >> 12) {
+        case OP_ADD:
+        case OP_AND: {
+            lane_vec operand = (instr >> 5) & 0x1 ? broadcast(sign_extend(instr & 0x1F, 5)) : R[instr & 0x7];
+            result = (instr >> 12) == OP_ADD ? R[sr] + operand : R[sr] & operand;
+            break;
+        }
+        case OP_NOT: {
+            result = ~R[sr];
+            break;
+        }
+        case OP_LEA: {
+            result = broadcast(next + offset9);
+            break;
+        }
+        case OP_LD: {
+            uint16_t address = next + offset9;
+            if (page_attr[address >> PAGE_SHIFT] & PAGE_READ_HOOK) {
+                return 0;
+            }
+            result = lanes.memory[address];
+            break;
+        }
+        case OP_LDR: {
+            lane_vec address = R[sr] + offset6;
+            uint16_t a = address[lead];
+            if (!uniform(address, mask, a) || (page_attr[a >> PAGE_SHIFT] & PAGE_READ_HOOK)) {
+                return 0;
+            }
+            result = lanes.memory[a];
+            break;
+        }
+        case OP_ST: {
+            uint16_t address = next + offset9;
+            if (page_attr[address >> PAGE_SHIFT] & PAGE_WRITE_HOOK) {
+                return 0;
+            }
+            lanes.memory[address] = blend(mask, R[dr], lanes.memory[address]);
+            R[R_PC] = blend(mask, broadcast(next), R[R_PC]);
+            retire(mask);
+            return 1;
+        }
+        case OP_STR: {
+            lane_vec address = R[sr] + offset6;
+            uint16_t a = address[lead];
+            if (!uniform(address, mask, a) || (page_attr[a >> PAGE_SHIFT] & PAGE_WRITE_HOOK)) {
+                return 0;
+            }
+            lanes.memory[a] = blend(mask, R[dr], lanes.memory[a]);
+            R[R_PC] = blend(mask, broadcast(next), R[R_PC]);
+            retire(mask);
+            return 1;
+        }
+        case OP_BR: {
+            lane_vec taken = (lane_vec)((R[R_COND] & dr) != 0);
+            R[R_PC] = blend(mask, blend(taken, broadcast(next + offset9), broadcast(next)), R[R_PC]);
+            retire(mask);
+            return 1;
+        }
+        case OP_JMP: {
+            R[R_PC] = blend(mask, R[sr], R[R_PC]);
+            retire(mask);
+            return 1;
+        }
+        case OP_JSR: {
+            R[R_R7] = blend(mask, broadcast(next), R[R_R7]);
+            lane_vec target = (instr >> 11) & 0x1 ? broadcast(next + sign_extend(instr & 0x7FF, 11)) : R[sr];
+            R[R_PC] = blend(mask, target, R[R_PC]);
+            retire(mask);
+            return 1;
+        }
+        default:
+            return 0;
+    }
+    R[dr] = blend(mask, result, R[dr]);
+    R[R_COND] = blend(mask, flags_of(result), R[R_COND]);
+    R[R_PC] = blend(mask, broadcast(next), R[R_PC]);
+    retire(mask);
+    return 1;
+}
+
+/*
+ * Pick lane whose PC runs next, lowest PC so lanes that branched ahead wait for the others to catch up,
+ * unless some lane waited longer than STARVE_LIMIT steps
+ */
+LANES_INLINE int pick_lane() {
+    int next = lanes.lead;
+    if (uniform(lanes.reg[R_PC], lanes.active, lanes.reg[R_PC][next])) {
+        return next;
+    }
+    int starved = -1;
+    for (int l = 0; l < LANES; l++) {
+        if (!lanes.active[l]) {
+            continue;
+        }
+        if (lanes.reg[R_PC][l] < lanes.reg[R_PC][next]) {
+            next = l;
+        }
+        if (lanes.waited[l] > STARVE_LIMIT && (starved < 0 || lanes.waited[l] > lanes.waited[starved])) {
+            starved = l;
+        }
+    }
+    return starved < 0 ? next : starved;
+}
+
+LANES_KERNEL static void run() {
+    /* a lane retires at most one instruction per step, fold counts before 16bit counters wrap */
+    uint16_t step = 0;
+    while (lanes.lead >= 0) {
+        int lead = pick_lane();
+        uint16_t pc = lanes.reg[R_PC][lead];
+        lane_vec mask = lanes.active & (lane_vec)(lanes.reg[R_PC] == pc);
+        if (!step_group(pc, mask, lead)) {
+            execute_each(mask);
+        }
+        lanes.waited = (lanes.waited - (lane_vec)(lanes.waited != 0xFFFF)) & ~mask;
+        if (++step == 0xFFFF) {
+            fold_retired();
+            step = 0;
+        }
+    }
+    fold_retired();
+}
+
+/* pattern is used as snprintf format, so it must hold exactly one %d & no other conversion */
+static int lane_pattern_valid(const char* pattern) {
+    int lane = 0;
+    for (const char* p = pattern; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        p++;
+        if (*p == 'd') {
+            lane++;
+        } else if (*p != '%') {
+            return 0;
+        }
+    }
+    return lane == 1;
+}
+
+static int lanes_open_io(int count, const char* input_format, const char* output_format) {
+    char path[512];
+    for (int l = 0; l < count; l++) {
+        struct lane_io* io = &lanes.io[l];
+        snprintf(path, sizeof(path), input_format, l);
+        FILE* in = fopen(path, "rb");
+        if (!in) {
+            fprintf(stderr, "lanes: can't open input %s\n", path);
+            return 0;
+        }
+        fseek(in, 0, SEEK_END);
+        long size = ftell(in);
+        fseek(in, 0, SEEK_SET);
+        io->input = malloc(size > 0 ? size : 1);
+        io->length = io->input ? fread(io->input, 1, size > 0 ? size : 0, in) : 0;
+        fclose(in);
+        if (output_format) {
+            snprintf(path, sizeof(path), output_format, l);
+            io->output = fopen(path, "wb");
+            if (!io->output) {
+                fprintf(stderr, "lanes: can't open output %s\n", path);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int lanes_run(int count, const char* input_format, const char* output_format) {
+    if (count < 1 || count > LANES) {
+        fprintf(stderr, "lanes: lane count must be 1 - %d\n", LANES);
+        return count;
+    }
+    if (!lane_pattern_valid(input_format) || (output_format && !lane_pattern_valid(output_format))) {
+        fprintf(stderr, "lanes: file name pattern must contain exactly one %%d (use %%%% for a literal %%)\n");
+        return count;
+    }
+    lanes.memory = aligned_alloc(sizeof(lane_vec), MEMORY_MAX * sizeof(lane_vec));
+    if (!lanes.memory || !lanes_open_io(count, input_format, output_format)) {
+        return count;
+    }
+    for (uint32_t a = 0; a < MEMORY_MAX; a++) {
+        lanes.memory[a] = broadcast(memory[a]);
+    }
+    for (int r = 0; r < R_COUNT; r++) {
+        lanes.reg[r] = broadcast(reg[r]);
+    }
+    for (int l = 0; l < LANES; l++) {
+        lanes.active[l] = l < count ? 0xFFFF : 0;
+        lanes.status[l] = LANE_RUNNING;
+    }
+    lanes.lead = 0;
+
+    run();
+
+    int faults = 0;
+    fprintf(stderr, "%4s %-7s %14s %10s\n", "LANE", "STATUS", "INSTR", "OUT");
+    for (int l = 0; l < count; l++) {
+        struct lane_io* io = &lanes.io[l];
+        faults += lanes.status[l] == LANE_FAULT;
+        fprintf(stderr, "%4d %-7s %14llu %10llu\n", l, lanes.status[l] == LANE_FAULT ? "fault" : "halted",
+                (unsigned long long)lanes.total[l], (unsigned long long)io->bytes_out);
+        if (io->output) {
+            fclose(io->output);
+        }
+        free(io->input);
+    }
+    free(lanes.memory);
+    return faults;
+}
@@ -0,0 +1,36 @@
+#ifndef _H_LANES_
+#define _H_LANES_
+
+#include<stdint.h>
+
+/*
+ * Multi-Lane Engine
+ * Runs LANES instances of the loaded image side by side, each with its own keyboard input & display output,
+ * for fuzzing & parameter sweeps where only the input differs between runs.
+ *
+ * State is kept in structure of arrays layout, register r of all lanes is one 256bit vector & so is every memory word,
+ * so an instruction that all lanes execute at the same PC is a handful of vector operations (AVX2 when the host has it,
+ * two SSE2 operations otherwise).
+ *
+ * Each step picks the lowest PC among running lanes & executes it for every lane sitting at that PC (masked execution).
+ * Lanes that branched away wait until the group catches up, so diverged lanes regroup as soon as their PCs meet again.
+ * When lanes at the same PC see different instruction words, or an access needs per lane addresses or devices
+ * (LDI, STI, TRAP, different LDR/STR addresses, device page), the group falls back to executing each lane on its own.
+ *
+ * Lanes run with standard traps (GETC, OUT, PUTS, IN, PUTSP, HALT) & devices: keyboard polling, display & machine control.
+ * Not supported, vm refuses the options & a lane using the rest stops with a fault:
+ *  - interrupts & exceptions: RTI, reserved opcode, keyboard interrupt enable, PSR
+ *  - timer (TMR, TMI)
+ *  - native traps (--native-traps), block device (--disk), lockstep (--lockstep) & frame coalescing (--coalesce)
+ *  - idiom recognition, lanes always interpret every instruction
+ */
+#define LANES 16
+
+/*
+ * Run `count` lanes (1 - LANES) from PC 0x3000 on a copy of memory[], keyboard input of lane i is read from the file
+ * named by input_format with i substituted for %d, output goes to output_format the same way or is discarded when NULL.
+ * Prints per lane summary to stderr, returns number of lanes that faulted.
+ */
+int lanes_run(int count, const char* input_format, const char* output_format);
+
+#endif
@@ -0,0 +1,290 @@
+#include "lockstep.h"
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "./core/block-device.h"
+#include "./core/core.h"
+#include "./core/interrupt.h"
+#include "./core/opcode.h"
+#include "./core/telemetry.h"
+
+/*
+ * what an engine sends at each checkpoint, followed by `writes` (address, value) pairs
+ * output of both engines is counted so a missing or extra character is a divergence too
+ */
+struct checkpoint {
+    uint64_t count;
+    uint64_t bytes_out;
+    uint32_t writes;
+    uint16_t halted;
+    uint16_t reg[R_COUNT];
+};
+
+/* Engine process */
+
+static uint8_t dirty[MEMORY_MAX];
+static uint16_t dirty_list[MEMORY_MAX];
+static uint32_t dirty_count;
+
+static void track_write(uint16_t address, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t a = address + i;
+        if (!dirty[a]) {
+            dirty[a] = 1;
+            dirty_list[dirty_count++] = a;
+        }
+    }
+}
+
+static void send_checkpoint(FILE* out, uint64_t count, uint16_t halted) {
+    struct checkpoint cp;
+    memset(&cp, 0, sizeof(cp));
+    cp.count = count;
+    cp.bytes_out = atomic_load_explicit(&telemetry->bytes_out, memory_order_relaxed);
+    cp.writes = dirty_count;
+    cp.halted = halted;
+    memcpy(cp.reg, reg, sizeof(cp.reg));
+    fwrite(&cp, sizeof(cp), 1, out);
+    for (uint32_t i = 0; i < dirty_count; i++) {
+        uint16_t a = dirty_list[i];
+        uint16_t pair[2] = {a, memory[a]};
+        fwrite(pair, sizeof(pair), 1, out);
+        dirty[a] = 0;
+    }
+    dirty_count = 0;
+}
+
+/*
+ * basic block ends with a control instruction whether it was taken or not, so an engine running a loop natively
+ * reports at the same point as one that interprets the final not taken branch. interrupt also ends a block
+ */
+static int ends_block(uint16_t opcode, uint16_t pc) {
+    switch (opcode) {
+        case OP_BR:
+        case OP_JMP:
+        case OP_JSR:
+        case OP_TRAP:
+        case OP_RTI:
+            return 1;
+        default:
+            return reg[R_PC] != (uint16_t)(pc + 1);
+    }
+}
+
+static void engine_run(const struct engine* e, FILE* out, int mode, uint64_t every, const char* input, int quiet) {
+    if (!freopen(input ? input : "/dev/null", "r", stdin)) {
+        fprintf(stderr, "lockstep: can't open input %s\n", input);
+        _exit(2);
+    }
+    if (quiet && !freopen("/dev/null", "w", stdout)) {
+        _exit(2);
+    }
+    /* both engines start from the same disk, neither may see the other's writes or change the file */
+    if (!block_device_private()) {
+        fprintf(stderr, "lockstep: can't remap disk\n");
+        _exit(2);
+    }
+    device_track_writes(track_write);
+    e->setup();
+
+    uint64_t count = 0;
+    int running = 1;
+    while (running) {
+        uint16_t pc = reg[R_PC];
+        uint16_t opcode = memory[pc] >> 12;
+        uint64_t retired = 0;
+        running = e->step(&retired);
+        uint64_t before = count;
+        count += retired;
+        if (!running) {
+            break;
+        }
+        if (count / DEVICE_POLL_INTERVAL != before / DEVICE_POLL_INTERVAL) {
+            device_poll();
+        }
+        if (interrupt_pending) {
+            interrupt_service();
+        }
+        if (mode == CHECKPOINT_INSTRUCTION || (mode == CHECKPOINT_BLOCK && ends_block(opcode, pc))
+            || (mode == CHECKPOINT_EVERY && count / every != before / every)) {
+            send_checkpoint(out, count, 0);
+        }
+    }
+    fflush(stdout);
+    send_checkpoint(out, count, 1);
+    fclose(out);
+    _exit(0);
+}
+
+static pid_t engine_start(const struct engine* e, FILE** in, int mode, uint64_t every, const char* input, int quiet) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        FILE* out = fdopen(fds[1], "w");
+        /* large buffer lets engine run ahead of the comparison instead of waking it for every checkpoint */
+        setvbuf(out, NULL, _IOFBF, 1 << 16);
+        engine_run(e, out, mode, every, input, quiet);
+    }
+    close(fds[1]);
+    *in = fdopen(fds[0], "r");
+    setvbuf(*in, NULL, _IOFBF, 1 << 16);
+    return pid;
+}
+
+/* Comparison */
+
+struct stream {
+    const char* name;
+    FILE* in;
+    struct checkpoint cp;
+    uint16_t* shadow; /* engine memory rebuilt from the writes it reported */
+};
+
+/* addresses written by either engine since last agreed checkpoint */
+static uint8_t touched[MEMORY_MAX];
+static uint16_t touched_list[MEMORY_MAX];
+static uint32_t touched_count;
+
+static int read_checkpoint(struct stream* s) {
+    if (fread(&s->cp, sizeof(s->cp), 1, s->in) != 1) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < s->cp.writes; i++) {
+        uint16_t pair[2];
+        if (fread(pair, sizeof(pair), 1, s->in) != 1) {
+            return 0;
+        }
+        s->shadow[pair[0]] = pair[1];
+        if (!touched[pair[0]]) {
+            touched[pair[0]] = 1;
+            touched_list[touched_count++] = pair[0];
+        }
+    }
+    return 1;
+}
+
+static const char* register_name(int r) {
+    static const char* names[R_COUNT] = {"R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "PC", "COND"};
+    return names[r];
+}
+
+/* print the differing part of the state, returns 1 if anything differs */
+static int report_diff(const struct stream* a, const struct stream* b, uint64_t agreed) {
+    int differ = a->cp.halted != b->cp.halted || a->cp.bytes_out != b->cp.bytes_out;
+    for (int r = 0; r < R_COUNT; r++) {
+        differ |= a->cp.reg[r] != b->cp.reg[r];
+    }
+    for (uint32_t i = 0; i < touched_count; i++) {
+        differ |= a->shadow[touched_list[i]] != b->shadow[touched_list[i]];
+    }
+    if (!differ) {
+        return 0;
+    }
+    fprintf(stderr, "\nlockstep: divergence at %llu instructions, last agreed checkpoint at %llu\n",
+            (unsigned long long)a->cp.count, (unsigned long long)agreed);
+    fprintf(stderr, "  %-10s %-10s %s\n", "", a->name, b->name);
+    if (a->cp.halted != b->cp.halted) {
+        fprintf(stderr, "  %-10s %-10s %s\n", "halted", a->cp.halted ? "yes" : "no", b->cp.halted ? "yes" : "no");
+    }
+    if (a->cp.bytes_out != b->cp.bytes_out) {
+        fprintf(stderr, "  %-10s %-10llu %llu\n", "output", (unsigned long long)a->cp.bytes_out,
+                (unsigned long long)b->cp.bytes_out);
+    }
+    for (int r = 0; r < R_COUNT; r++) {
+        if (a->cp.reg[r] != b->cp.reg[r]) {
+            fprintf(stderr, "  %-10s x%04X      x%04X\n", register_name(r), a->cp.reg[r], b->cp.reg[r]);
+        }
+    }
+    for (uint32_t i = 0; i < touched_count; i++) {
+        uint16_t addr = touched_list[i];
+        if (a->shadow[addr] != b->shadow[addr]) {
+            fprintf(stderr, "  mem x%04X x%04X      x%04X\n", addr, a->shadow[addr], b->shadow[addr]);
+        }
+    }
+    return 1;
+}
+
+static void halt_report(const struct stream* a, const struct stream* b) {
+    fprintf(stderr, "\nlockstep: %s halted at %llu instructions (PC x%04X), %s reached %llu (PC x%04X)\n", a->name,
+            (unsigned long long)a->cp.count, a->cp.reg[R_PC], b->name, (unsigned long long)b->cp.count, b->cp.reg[R_PC]);
+}
+
+int lockstep_run(const struct engine* reference, const struct engine* candidate, int mode, uint64_t every,
+                 const char* input) {
+    static uint16_t shadow[2][MEMORY_MAX];
+    memcpy(shadow[0], memory, sizeof(memory));
+    memcpy(shadow[1], memory, sizeof(memory));
+    struct stream ref = {reference->name, NULL, {0}, shadow[0]};
+    struct stream cand = {candidate->name, NULL, {0}, shadow[1]};
+
+    pid_t ref_pid = engine_start(reference, &ref.in, mode, every, input, 0);
+    pid_t cand_pid = engine_start(candidate, &cand.in, mode, every, input, 1);
+    if (ref_pid < 0 || cand_pid < 0) {
+        fprintf(stderr, "lockstep: can't start engines\n");
+        return 1;
+    }
+
+    int result = 1;
+    uint64_t agreed = 0;
+    uint64_t checkpoints = 0;
+    int ref_ok = read_checkpoint(&ref);
+    int cand_ok = read_checkpoint(&cand);
+    while (ref_ok && cand_ok) {
+        /* engine behind skips ahead, its writes are already replayed onto its shadow */
+        if (ref.cp.count < cand.cp.count && !ref.cp.halted) {
+            ref_ok = read_checkpoint(&ref);
+            continue;
+        }
+        if (cand.cp.count < ref.cp.count && !cand.cp.halted) {
+            cand_ok = read_checkpoint(&cand);
+            continue;
+        }
+        if (ref.cp.count != cand.cp.count) {
+            ref.cp.halted ? halt_report(&ref, &cand) : halt_report(&cand, &ref);
+            break;
+        }
+        if (report_diff(&ref, &cand, agreed)) {
+            break;
+        }
+        for (uint32_t i = 0; i < touched_count; i++) {
+            touched[touched_list[i]] = 0;
+        }
+        touched_count = 0;
+        agreed = ref.cp.count;
+        checkpoints++;
+        if (ref.cp.halted) {
+            fprintf(stderr, "\nlockstep: %s & %s agree, %llu instructions, %llu checkpoints\n", ref.name, cand.name,
+                    (unsigned long long)agreed, (unsigned long long)checkpoints);
+            result = 0;
+            break;
+        }
+        ref_ok = read_checkpoint(&ref);
+        cand_ok = read_checkpoint(&cand);
+    }
+    if (!ref_ok || !cand_ok) {
+        fprintf(stderr, "\nlockstep: %s stopped without halting\n", !ref_ok ? ref.name : cand.name);
+    }
+    kill(ref_pid, SIGKILL);
+    kill(cand_pid, SIGKILL);
+    waitpid(ref_pid, NULL, 0);
+    waitpid(cand_pid, NULL, 0);
+    fclose(ref.in);
+    fclose(cand.in);
+    return result;
+}
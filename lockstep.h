@@ -0,0 +1,49 @@
+#ifndef _H_LOCKSTEP_
+#define _H_LOCKSTEP_
+
+#include<stdint.h>
+
+/*
+ * Execution engine
+ * setup prepares engine state after images are loaded, step executes from current PC, sets how many guest instructions
+ * it retired (a native loop may retire many at once) & returns 0 once the machine has stopped
+ */
+struct engine {
+    const char* name;
+    void (*setup)();
+    int (*step)(uint64_t* retired);
+};
+
+/*
+ * Checkpoint granularity
+ * CHECKPOINT_INSTRUCTION -> after every step
+ * CHECKPOINT_BLOCK -> after every control instruction (BR, JMP, JSR, TRAP, RTI) & interrupt, taken or not
+ * CHECKPOINT_EVERY -> whenever retired count crosses a multiple of N
+ */
+enum {
+    CHECKPOINT_INSTRUCTION = 0,
+    CHECKPOINT_BLOCK,
+    CHECKPOINT_EVERY,
+};
+
+/*
+ * Differential Lockstep Mode
+ * Reference & candidate engine run in their own forked process on the same loaded image, both read keyboard input from
+ * the same file (/dev/null when NULL). Only reference output reaches stdout.
+ * At each checkpoint an engine sends its registers & every word written since its previous checkpoint to this process,
+ * which replays the writes onto its own copy of each engine's memory. Checkpoints are compared when both engines report
+ * the same retired instruction count, so an engine that retires a whole loop in one step is compared at the next
+ * checkpoint both of them reach. Run stops at the first divergence & prints only the registers & words that differ.
+ *
+ * Interrupts are delivered when retired count crosses the device poll interval, guests relying on host timing
+ * (timer) or an engine retiring instructions in bulk across that point can legitimately diverge.
+ *
+ * A block device is remapped copy on write in each engine, so both start from the same sectors & the disk file is
+ * left unchanged.
+ *
+ * returns 0 if both engines halted in the same state, 1 on divergence
+ */
+int lockstep_run(const struct engine* reference, const struct engine* candidate, int mode, uint64_t every,
+                 const char* input);
+
+#endif
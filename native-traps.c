@@ -0,0 +1,122 @@
+#include "native-traps.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "./core/console.h"
+#include "./core/core.h"
+#include "instruction-set.h"
+
+uint16_t op_trap_mul(uint16_t instr) {
+    reg[R_R0] = (uint16_t)(reg[R_R0] * reg[R_R1]);
+    update_flags(R_R0);
+    return 1;
+}
+
+static uint16_t divide_by_zero() {
+    console_sync();
+    puts("DIVIDE BY ZERO");
+    fflush(stdout);
+    return 0;
+}
+
+uint16_t op_trap_div(uint16_t instr) {
+    if (!reg[R_R1]) {
+        return divide_by_zero();
+    }
+    int32_t dividend = (int16_t)reg[R_R0];
+    int32_t divisor = (int16_t)reg[R_R1];
+    reg[R_R0] = (uint16_t)(dividend / divisor);
+    reg[R_R1] = (uint16_t)(dividend % divisor);
+    update_flags(R_R0);
+    return 1;
+}
+
+uint16_t op_trap_mod(uint16_t instr) {
+    if (!reg[R_R1]) {
+        return divide_by_zero();
+    }
+    int32_t dividend = (int16_t)reg[R_R0];
+    int32_t divisor = (int16_t)reg[R_R1];
+    reg[R_R0] = (uint16_t)(dividend % divisor);
+    update_flags(R_R0);
+    return 1;
+}
+
+uint16_t op_trap_memcpy(uint16_t instr) {
+    uint16_t dst = reg[R_R0];
+    uint16_t src = reg[R_R1];
+    uint16_t count = reg[R_R2];
+    if (range_is_ram(dst, count) && range_is_ram(src, count)) {
+        memmove(memory + dst, memory + src, count * sizeof(uint16_t));
+        memory_written(dst, count);
+        return 1;
+    }
+    /* copy backwards when destination starts inside source so source words are read before they are overwritten */
+    if ((uint16_t)(dst - src) < count) {
+        for (uint16_t i = count; i > 0; i--) {
+            mem_write(dst + i - 1, mem_read(src + i - 1));
+        }
+    } else {
+        for (uint16_t i = 0; i < count; i++) {
+            mem_write(dst + i, mem_read(src + i));
+        }
+    }
+    return 1;
+}
+
+uint16_t op_trap_memset(uint16_t instr) {
+    uint16_t dst = reg[R_R0];
+    uint16_t val = reg[R_R1];
+    uint16_t count = reg[R_R2];
+    if (range_is_ram(dst, count)) {
+        uint16_t* p = memory + dst;
+        for (uint16_t i = 0; i < count; i++) {
+            *p++ = val;
+        }
+        memory_written(dst, count);
+        return 1;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        mem_write(dst + i, val);
+    }
+    return 1;
+}
+
+uint16_t op_trap_memcmp(uint16_t instr) {
+    uint16_t a = reg[R_R0];
+    uint16_t b = reg[R_R1];
+    uint16_t count = reg[R_R2];
+    int result = 0;
+    if (range_is_ram(a, count) && range_is_ram(b, count)) {
+        /* memcmp compares bytes which only orders 16bit words correctly on big endian host, so find first difference & compare it */
+        for (uint16_t i = 0; i < count; i++) {
+            if (memory[a + i] != memory[b + i]) {
+                result = memory[a + i] < memory[b + i] ? -1 : 1;
+                break;
+            }
+        }
+    } else {
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t x = mem_read(a + i);
+            uint16_t y = mem_read(b + i);
+            if (x != y) {
+                result = x < y ? -1 : 1;
+                break;
+            }
+        }
+    }
+    reg[R_R0] = (uint16_t)result;
+    update_flags(R_R0);
+    return 1;
+}
+
+void native_trap_setup() {
+    trap_register(TRAP_MUL, op_trap_mul);
+    trap_register(TRAP_DIV, op_trap_div);
+    trap_register(TRAP_MOD, op_trap_mod);
+    trap_register(TRAP_MEMCPY, op_trap_memcpy);
+    trap_register(TRAP_MEMSET, op_trap_memset);
+    trap_register(TRAP_MEMCMP, op_trap_memcmp);
+}
@@ -0,0 +1,38 @@
+#ifndef _H_NATIVE_TRAPS_
+#define _H_NATIVE_TRAPS_
+
+#include<stdint.h>
+#include "./core/opcode.h"
+
+/*
+ * Native accelerator traps
+ * LC-3 has no multiply or divide & copying memory is a word by word loop, these traps do the same work in one host call
+ * they use vectors 0x30 - 0x35 which are free in standard LC-3 so they are only registered on request (--native-traps),
+ * images using standard trap semantics keep their behaviour by default
+ *
+ * Arithmetic traps set condition codes from R0, memory traps go through mem_read/mem_write word by word
+ * when the range touches a device page or wraps past 0xFFFF, otherwise they work on memory[] directly
+ */
+
+/* Multiply R0 = R0 * R1, lower 16 bits of the product */
+uint16_t op_trap_mul(uint16_t instruction);
+
+/* Signed divide R0 = R0 / R1 rounded towards zero & R1 = remainder, dividing by zero stops the machine */
+uint16_t op_trap_div(uint16_t instruction);
+
+/* Signed remainder R0 = R0 % R1, sign follows the dividend, dividing by zero stops the machine */
+uint16_t op_trap_mod(uint16_t instruction);
+
+/* Block copy R2 words from [R1] to [R0], overlapping ranges are copied as if through a temporary buffer */
+uint16_t op_trap_memcpy(uint16_t instruction);
+
+/* Block fill R2 words starting at [R0] with value in R1 */
+uint16_t op_trap_memset(uint16_t instruction);
+
+/* Block compare R2 words at [R0] & [R1] as unsigned words, R0 = -1, 0 or 1 from the first differing word */
+uint16_t op_trap_memcmp(uint16_t instruction);
+
+/* register all accelerator traps in trap table */
+void native_trap_setup();
+
+#endif
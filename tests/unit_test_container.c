@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../core/container.h"
+#include "../core/core.h"
+#include "../core/read-image.h"
+
+/*
+ * Container loader must reject every malformed file without touching memory, including ones whose
+ * offsets only fit when 64bit sums wrap, hash is recomputed for each case so only the bounds checks can catch them
+ */
+
+#define ORIGIN 0x3000
+#define WORDS 4
+#define FILE_SIZE (2 * CONTAINER_ALIGN)
+
+struct layout {
+    struct container_header header;
+    struct container_section section;
+    struct container_symbol symbol;
+    char names[8];
+};
+
+static uint8_t file[FILE_SIZE];
+static int failures;
+
+static void build() {
+    struct layout* l = (void*)file;
+    memset(file, 0, sizeof(file));
+    memcpy(l->header.magic, CONTAINER_MAGIC, sizeof(l->header.magic));
+    l->header.version = CONTAINER_VERSION;
+    l->header.endian = CONTAINER_ENDIAN;
+    l->header.section_count = 1;
+    l->header.symbol_count = 1;
+    l->header.symbol_offset = offsetof(struct layout, symbol);
+    l->header.strings_offset = offsetof(struct layout, names);
+    l->header.strings_size = sizeof(l->names);
+    l->section.origin = ORIGIN;
+    l->section.words = WORDS;
+    l->section.offset = CONTAINER_ALIGN;
+    l->symbol.address = ORIGIN;
+    strcpy(l->names, "MAIN");
+    uint16_t* data = (uint16_t*)(file + CONTAINER_ALIGN);
+    for (int i = 0; i < WORDS; i++) {
+        data[i] = 0x1000 + i;
+    }
+}
+
+static void rehash() {
+    struct layout* l = (void*)file;
+    l->header.hash = 0;
+    l->header.hash = container_hash(CONTAINER_HASH_SEED, file, sizeof(file));
+}
+
+static uint16_t load() {
+    char path[] = "/tmp/unit_test_container_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, file, sizeof(file)) != sizeof(file)) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+    memset(memory + ORIGIN, 0, WORDS * sizeof(uint16_t));
+    uint16_t loaded = read_image(path);
+    unlink(path);
+    return loaded;
+}
+
+static void expect(const char* name, uint16_t loaded, uint16_t expected) {
+    if (loaded != expected || (!loaded && memory[ORIGIN])) {
+        printf("FAIL %s\n", name);
+        failures++;
+    }
+}
+
+int main() {
+    struct layout* l = (void*)file;
+
+    build();
+    rehash();
+    expect("valid", load(), 1);
+    uint16_t offset;
+    if (memory[ORIGIN + WORDS - 1] != 0x1000 + WORDS - 1 || !image_symbol(ORIGIN + 1, &offset) || offset != 1) {
+        printf("FAIL valid contents\n");
+        failures++;
+    }
+
+    build();
+    l->section.offset = 0 - (uint64_t)CONTAINER_ALIGN;
+    rehash();
+    expect("section offset wraps", load(), 0);
+
+    build();
+    l->section.offset = 2 * CONTAINER_ALIGN;
+    rehash();
+    expect("section past end", load(), 0);
+
+    build();
+    l->section.origin = 0xFFFE;
+    rehash();
+    expect("section past memory", load(), 0);
+
+    build();
+    l->header.symbol_offset = 0 - (uint64_t)sizeof(struct container_symbol);
+    rehash();
+    expect("symbol offset wraps", load(), 0);
+
+    build();
+    l->header.strings_offset = 0 - (uint64_t)sizeof(l->names);
+    rehash();
+    expect("strings offset wraps", load(), 0);
+
+    build();
+    l->header.strings_size = 0 - (uint64_t)l->header.strings_offset;
+    rehash();
+    expect("strings size wraps", load(), 0);
+
+    build();
+    l->header.section_count = 0xFFFFFFFF;
+    rehash();
+    expect("section count", load(), 0);
+
+    build();
+    rehash();
+    file[CONTAINER_ALIGN] ^= 1;
+    expect("bad hash", load(), 0);
+
+    if (!failures) {
+        printf("container: all passed\n");
+    }
+    return failures != 0;
+}
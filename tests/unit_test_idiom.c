@@ -0,0 +1,251 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../core/core.h"
+#include "../core/opcode.h"
+
+/*
+ * Native idiom loops must leave exactly the registers, R_COND & memory interpreting them would.
+ * Every case is run by lc3 --lockstep idiom --checkpoint instr, which compares the idiom engine with the plain
+ * interpreter after every step. A loop run natively retires many instructions in one step, so it has fewer
+ * checkpoints than instructions, a loop that must fall back to the interpreter has one per instruction.
+ * unit_test_idiom path-to-lc3
+ */
+
+#define ORIGIN 0x3000
+#define DATA 0x3100
+#define IMAGE_WORDS 0x200
+
+enum {
+    NATIVE = 1,
+    FALLBACK = 0,
+};
+
+static uint16_t image[IMAGE_WORDS];
+static int image_len;
+static const char* lc3;
+static int failures;
+
+static void op(uint16_t instr) {
+    image[image_len++] = instr;
+}
+
+static uint16_t here() {
+    return ORIGIN + image_len;
+}
+
+static uint16_t add_reg(int dr, int sr1, int sr2) {
+    return OP_ADD << 12 | dr << 9 | sr1 << 6 | sr2;
+}
+
+static uint16_t add_imm(int dr, int sr, int imm) {
+    return OP_ADD << 12 | dr << 9 | sr << 6 | 0x20 | (imm & 0x1F);
+}
+
+static uint16_t and_reg(int dr, int sr1, int sr2) {
+    return OP_AND << 12 | dr << 9 | sr1 << 6 | sr2;
+}
+
+static uint16_t branch(int nzp, int offset) {
+    return OP_BR << 12 | nzp << 9 | (offset & 0x1FF);
+}
+
+static uint16_t ldr(int dr, int base, int offset) {
+    return OP_LDR << 12 | dr << 9 | base << 6 | (offset & 0x3F);
+}
+
+static uint16_t str(int sr, int base, int offset) {
+    return OP_STR << 12 | sr << 9 | base << 6 | (offset & 0x3F);
+}
+
+static void halt() {
+    op(OP_TRAP << 12 | TRAP_HALT);
+}
+
+/* LD r from the word right after an unconditional branch over it */
+static void load(int r, uint16_t value) {
+    op(OP_LD << 12 | r << 9 | 1);
+    op(branch(FL_NEG | FL_ZRO | FL_POS, 1));
+    op(value);
+}
+
+/* words at DATA + i */
+static void data(uint16_t first, int count) {
+    for (int i = 0; i < count; i++) {
+        image[DATA - ORIGIN + i] = first + i;
+    }
+    if (image_len < DATA - ORIGIN + count) {
+        image_len = DATA - ORIGIN + count;
+    }
+}
+
+static void mul_add(uint16_t count) {
+    load(R_R1, 0);
+    load(R_R2, 7);
+    load(R_R3, count);
+    op(add_reg(R_R1, R_R1, R_R2));
+    op(add_imm(R_R3, R_R3, -1));
+    op(branch(FL_POS, -3));
+    halt();
+}
+
+static void mul_shift(uint16_t mask) {
+    load(R_R0, 0);
+    load(R_R1, 5);
+    load(R_R2, 0x1234);
+    load(R_R3, mask);
+    op(and_reg(R_R4, R_R2, R_R3));
+    op(branch(FL_ZRO, 1));
+    op(add_reg(R_R0, R_R0, R_R1));
+    op(add_reg(R_R1, R_R1, R_R1));
+    op(add_reg(R_R3, R_R3, R_R3));
+    op(branch(FL_NEG | FL_POS, -6));
+    halt();
+}
+
+/* divisor is given negated, as the guest keeps it */
+static void divide(uint16_t dividend, uint16_t negated_divisor) {
+    load(R_R1, dividend);
+    load(R_R2, negated_divisor);
+    load(R_R3, 0);
+    op(add_reg(R_R1, R_R1, R_R2));
+    op(branch(FL_NEG, 2));
+    op(add_imm(R_R3, R_R3, 1));
+    op(branch(FL_NEG | FL_ZRO | FL_POS, -4));
+    halt();
+}
+
+/* dst = 0 copies into the loop body itself, starting 3 words before its head */
+static void copy(uint16_t src, uint16_t dst, uint16_t count) {
+    data(1, 0x40);
+    load(R_R1, src);
+    load(R_R2, dst ? dst : here() + 3);
+    load(R_R3, count);
+    op(ldr(R_R0, R_R1, 0));
+    op(str(R_R0, R_R2, 0));
+    op(add_imm(R_R1, R_R1, 1));
+    op(add_imm(R_R2, R_R2, 1));
+    op(add_imm(R_R3, R_R3, -1));
+    op(branch(FL_POS, -6));
+    halt();
+}
+
+/* dst = 0 fills the loop body itself, starting 2 words before its head */
+static void fill(uint16_t dst, uint16_t count) {
+    load(R_R0, 0);
+    load(R_R1, dst ? dst : here() + 4);
+    load(R_R2, count);
+    op(str(R_R0, R_R1, 0));
+    op(add_imm(R_R1, R_R1, 1));
+    op(add_imm(R_R2, R_R2, -1));
+    op(branch(FL_POS, -4));
+    halt();
+}
+
+static uint16_t swap16(uint16_t x) {
+    return (x << 8) | (x >> 8);
+}
+
+static void run(const char* name, int expected) {
+    char path[] = "/tmp/unit_test_idiom_XXXXXX";
+    int fd = mkstemp(path);
+    uint16_t words[IMAGE_WORDS + 1];
+    words[0] = swap16(ORIGIN);
+    for (int i = 0; i < image_len; i++) {
+        words[i + 1] = swap16(image[i]);
+    }
+    size_t size = (image_len + 1) * sizeof(uint16_t);
+    if (fd < 0 || write(fd, words, size) != (ssize_t)size) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+
+    char command[512];
+    snprintf(command, sizeof(command), "%s --lockstep idiom --checkpoint instr %s 2>&1 </dev/null", lc3, path);
+    FILE* out = popen(command, "r");
+    if (!out) {
+        perror("popen");
+        exit(1);
+    }
+    char line[256];
+    unsigned long long instructions = 0, checkpoints = 0;
+    int agreed = 0;
+    while (fgets(line, sizeof(line), out)) {
+        const char* summary = strstr(line, "agree, ");
+        if (summary && sscanf(summary, "agree, %llu instructions, %llu checkpoints", &instructions, &checkpoints) == 2) {
+            agreed = 1;
+        }
+    }
+    int status = pclose(out);
+    unlink(path);
+
+    if (!agreed || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        printf("FAIL %s: engines diverged\n", name);
+        failures++;
+    } else if (expected == NATIVE && checkpoints == instructions) {
+        printf("FAIL %s: loop was not run natively\n", name);
+        failures++;
+    } else if (expected == FALLBACK && checkpoints != instructions) {
+        printf("FAIL %s: loop should have been interpreted\n", name);
+        failures++;
+    }
+    memset(image, 0, sizeof(image));
+    image_len = 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "unit_test_idiom path-to-lc3\n");
+        return 2;
+    }
+    lc3 = argv[1];
+
+    mul_add(100);
+    run("mul add", NATIVE);
+
+    mul_shift(1);
+    run("mul shift", NATIVE);
+    mul_shift(4);
+    run("mul shift mask above bit 0", NATIVE);
+    mul_shift(0x4000);
+    run("mul shift mask at bit 14", NATIVE);
+
+    divide(1000, -7);
+    run("div", NATIVE);
+    /* first iteration leaves 0x8000 + 0x8000 = 0, loop is entered with a zero dividend */
+    divide(0x8000, 0x8000);
+    run("div by 0x8000 zero dividend", NATIVE);
+    /* -1 + -32768 wraps to 32767 */
+    divide(0xFFFF, 0x8000);
+    run("div by 0x8000 wrapping dividend", NATIVE);
+
+    copy(DATA, DATA + 0x80, 20);
+    run("copy", NATIVE);
+    copy(DATA, DATA + 3, 20);
+    run("copy destination inside source", NATIVE);
+    copy(DATA + 5, DATA, 20);
+    run("copy source inside destination", NATIVE);
+    copy(DATA, 0xFDFC, 8);
+    run("copy destination touches device page", FALLBACK);
+    copy(0xFDFA, DATA, 8);
+    run("copy source touches device page", FALLBACK);
+    copy(DATA, 0, 8);
+    run("copy over loop body", FALLBACK);
+
+    fill(DATA, 30);
+    run("fill", NATIVE);
+    fill(0xFDFD, 6);
+    run("fill touches device page", FALLBACK);
+    fill(0, 10);
+    run("fill over loop body", FALLBACK);
+
+    if (!failures) {
+        printf("idiom: all passed\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,103 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../analysis.h"
+#include "../core/container.h"
+#include "../core/read-image.h"
+
+/*
+ * lc3-analyze
+ * Find basic blocks, control flow, subroutine entries, TRAP sites & unresolved indirect jumps of images & save them
+ * in a sidecar the vm picks up at startup, see analysis.h
+ * lc3-analyze [-v] [-o sidecar-file] image-file1 ...
+ * images are given the same way as to lc3, sidecar defaults to first image name + ANALYSIS_SUFFIX
+ */
+
+static void usage() {
+    fprintf(stderr, "lc3-analyze [-v] [-o sidecar-file] image-file1 ...\n");
+}
+
+static void print_analysis(const struct analysis* a) {
+    const struct analysis_header* h = &a->header;
+    uint32_t edge = 0;
+    for (uint32_t i = 0; i < h->block_count; i++) {
+        uint16_t start = a->blocks[i].start;
+        uint16_t last = start + a->blocks[i].length - 1;
+        printf("block x%04X - x%04X ->", start, last);
+        for (; edge < h->edge_count && a->edges[edge].from <= last; edge++) {
+            printf(" x%04X", a->edges[edge].to);
+        }
+        printf("\n");
+    }
+    for (uint32_t i = 0; i < h->entry_count; i++) {
+        printf("entry x%04X\n", a->entries[i]);
+    }
+    for (uint32_t i = 0; i < h->loop_count; i++) {
+        printf("loop x%04X\n", a->loops[i]);
+    }
+    for (uint32_t i = 0; i < h->trap_count; i++) {
+        printf("trap x%04X x%02X\n", a->traps[i].address, a->traps[i].vector);
+    }
+    for (uint32_t i = 0; i < h->indirect_count; i++) {
+        printf("indirect x%04X R%u\n", a->indirects[i].address, a->indirects[i].base);
+    }
+    for (uint32_t i = 0; i < h->vector_count; i++) {
+        printf("vector x%04X\n", a->vectors[i]);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* output = NULL;
+    const char* first = NULL;
+    int verbose = 0;
+    uint64_t image_hash = CONTAINER_HASH_SEED;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else {
+            if (!read_image(argv[i])) {
+                fprintf(stderr, "failed to load image: %s\n", argv[i]);
+                return 1;
+            }
+            if (!first) {
+                first = argv[i];
+            }
+            image_hash = analysis_hash_file(image_hash, argv[i]);
+        }
+    }
+    if (!first) {
+        usage();
+        return 2;
+    }
+    char path[4096];
+    if (!output) {
+        snprintf(path, sizeof(path), "%s%s", first, ANALYSIS_SUFFIX);
+        output = path;
+    }
+
+    struct analysis analysis;
+    if (!analysis_run(&analysis, image_hash)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if (verbose) {
+        print_analysis(&analysis);
+    }
+    if (!analysis_write(&analysis, output)) {
+        fprintf(stderr, "failed to write: %s\n", output);
+        analysis_free(&analysis);
+        return 1;
+    }
+    const struct analysis_header* h = &analysis.header;
+    printf("%s: %u blocks, %u edges, %u entries, %u traps, %u loops, %u unresolved indirect jumps, %u unresolved vectors\n",
+           output, h->block_count, h->edge_count, h->entry_count, h->trap_count, h->loop_count, h->indirect_count,
+           h->vector_count);
+    analysis_free(&analysis);
+    return 0;
+}
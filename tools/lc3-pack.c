@@ -0,0 +1,235 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/container.h"
+
+/*
+ * lc3-pack
+ * Convert .obj images into one container image, see core/container.h
+ * lc3-pack [-s symbol-file] [-z min-zero-run] -o out-file image-file1 ...
+ *
+ * Later images overwrite earlier ones where they overlap, same as loading them one after another.
+ * Runs of at least min-zero-run zero words become zero fill sections instead of data, default is one CONTAINER_ALIGN page
+ * as every data section after a split is padded to a page again.
+ * Symbol file is the .sym written by lc3as (lines like "//	LOOP	3004"), plain "LOOP 3004" lines work too.
+ */
+
+#define MEMORY_WORDS (1 << 16)
+#define NAME_MAX_LEN 64
+
+static uint16_t image[MEMORY_WORDS];
+static uint8_t present[MEMORY_WORDS];
+
+static struct container_section sections[MEMORY_WORDS];
+static uint32_t section_count;
+
+static struct container_symbol symbols[MEMORY_WORDS];
+static uint32_t symbol_count;
+static char* strings;
+static size_t strings_size;
+
+static uint16_t swap16(uint16_t x) {
+    return (x << 8) | (x >> 8);
+}
+
+static int read_obj(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    uint16_t origin;
+    if (fread(&origin, sizeof(origin), 1, file) != 1) {
+        fclose(file);
+        return 0;
+    }
+    origin = swap16(origin);
+    uint16_t word;
+    for (uint32_t address = origin; address < MEMORY_WORDS && fread(&word, sizeof(word), 1, file) == 1; address++) {
+        image[address] = swap16(word);
+        present[address] = 1;
+    }
+    fclose(file);
+    return 1;
+}
+
+static int is_hex(const char* s) {
+    if (!*s) {
+        return 0;
+    }
+    for (; *s; s++) {
+        if (!strchr("0123456789abcdefABCDEF", *s)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int read_symbols(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    char line[256];
+    char name[NAME_MAX_LEN];
+    char address[NAME_MAX_LEN];
+    while (fgets(line, sizeof(line), file) && symbol_count < MEMORY_WORDS) {
+        char* p = line;
+        if (strncmp(p, "//", 2) == 0) {
+            p += 2;
+        }
+        /* x3004 style addresses are accepted as well */
+        if (sscanf(p, "%63s %63s", name, address) != 2 || name[0] == '-') {
+            continue;
+        }
+        const char* digits = address[0] == 'x' || address[0] == 'X' ? address + 1 : address;
+        if (!is_hex(digits)) {
+            continue;
+        }
+        size_t len = strlen(name) + 1;
+        char* grown = realloc(strings, strings_size + len);
+        if (!grown) {
+            break;
+        }
+        strings = grown;
+        memcpy(strings + strings_size, name, len);
+        symbols[symbol_count].address = strtoul(digits, NULL, 16);
+        symbols[symbol_count].name = strings_size;
+        symbol_count++;
+        strings_size += len;
+    }
+    fclose(file);
+    return 1;
+}
+
+static void add_section(uint32_t origin, uint32_t words, uint16_t flags) {
+    sections[section_count].origin = origin;
+    sections[section_count].words = words;
+    sections[section_count].flags = flags;
+    sections[section_count].offset = 0;
+    section_count++;
+}
+
+/* every run of loaded words becomes data sections, with long zero runs inside them split out as zero fill */
+static void build_sections(uint32_t zero_run) {
+    uint32_t address = 0;
+    while (address < MEMORY_WORDS) {
+        if (!present[address]) {
+            address++;
+            continue;
+        }
+        uint32_t data_start = address;
+        while (address < MEMORY_WORDS && present[address]) {
+            uint32_t zeros = 0;
+            while (address + zeros < MEMORY_WORDS && present[address + zeros] && !image[address + zeros]) {
+                zeros++;
+            }
+            if (zeros >= zero_run) {
+                if (address > data_start) {
+                    add_section(data_start, address - data_start, 0);
+                }
+                add_section(address, zeros, SECTION_ZERO);
+                data_start = address + zeros;
+            }
+            address += zeros ? zeros : 1;
+        }
+        if (address > data_start) {
+            add_section(data_start, address - data_start, 0);
+        }
+    }
+}
+
+static uint64_t align(uint64_t offset, uint64_t to) {
+    return (offset + to - 1) / to * to;
+}
+
+static int write_container(const char* path) {
+    struct container_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CONTAINER_MAGIC, sizeof(header.magic));
+    header.version = CONTAINER_VERSION;
+    header.endian = CONTAINER_ENDIAN;
+    header.section_count = section_count;
+    header.symbol_count = symbol_count;
+    header.symbol_offset = align(sizeof(header) + section_count * sizeof(struct container_section), sizeof(struct container_symbol));
+    header.strings_offset = header.symbol_offset + symbol_count * sizeof(struct container_symbol);
+    header.strings_size = strings_size;
+
+    uint64_t size = align(header.strings_offset + strings_size, CONTAINER_ALIGN);
+    for (uint32_t i = 0; i < section_count; i++) {
+        if (sections[i].flags & SECTION_ZERO) {
+            continue;
+        }
+        sections[i].offset = size;
+        size = align(size + sections[i].words * sizeof(uint16_t), CONTAINER_ALIGN);
+    }
+
+    uint8_t* file = calloc(1, size);
+    if (!file) {
+        return 0;
+    }
+    memcpy(file, &header, sizeof(header));
+    memcpy(file + sizeof(header), sections, section_count * sizeof(struct container_section));
+    memcpy(file + header.symbol_offset, symbols, symbol_count * sizeof(struct container_symbol));
+    memcpy(file + header.strings_offset, strings, strings_size);
+    for (uint32_t i = 0; i < section_count; i++) {
+        if (!(sections[i].flags & SECTION_ZERO)) {
+            memcpy(file + sections[i].offset, image + sections[i].origin, sections[i].words * sizeof(uint16_t));
+        }
+    }
+    /* hash field is still 0 in the buffer */
+    header.hash = container_hash(CONTAINER_HASH_SEED, file, size);
+    memcpy(file, &header, sizeof(header));
+
+    FILE* out = fopen(path, "wb");
+    int written = out && fwrite(file, 1, size, out) == size;
+    if (out && fclose(out)) {
+        written = 0;
+    }
+    free(file);
+    return written;
+}
+
+int main(int argc, char* argv[]) {
+    const char* output = NULL;
+    const char* symbol_file = NULL;
+    uint32_t zero_run = CONTAINER_ALIGN / sizeof(uint16_t);
+    int images = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            symbol_file = argv[++i];
+        } else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+            zero_run = strtoul(argv[++i], NULL, 0);
+            if (!zero_run) {
+                zero_run = 1;
+            }
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "lc3-pack [-s symbol-file] [-z min-zero-run] -o out-file image-file1 ...\n");
+            return 2;
+        } else {
+            if (!read_obj(argv[i])) {
+                fprintf(stderr, "failed to load image: %s\n", argv[i]);
+                return 1;
+            }
+            images++;
+        }
+    }
+    if (!output || !images) {
+        fprintf(stderr, "lc3-pack [-s symbol-file] [-z min-zero-run] -o out-file image-file1 ...\n");
+        return 2;
+    }
+    if (symbol_file && !read_symbols(symbol_file)) {
+        fprintf(stderr, "failed to read symbols: %s\n", symbol_file);
+        return 1;
+    }
+    build_sections(zero_run);
+    if (!write_container(output)) {
+        fprintf(stderr, "failed to write: %s\n", output);
+        return 1;
+    }
+    printf("%s: %u sections, %u symbols\n", output, section_count, symbol_count);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../core/telemetry.h"
+
+/*
+ * lc3-top
+ * Sample telemetry of every running vm from TELEMETRY_DIR without pausing them
+ * lc3-top [-d delay-seconds] [-n iterations]
+ */
+
+/* vm is considered idle when it has not published for this long */
+#define IDLE_NS 1000000000ULL
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t load(_Atomic uint64_t* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/* three most used trap vectors as x21:120 x25:1 */
+static void format_traps(struct telemetry* t, char* out, size_t size) {
+    int used[3] = {-1, -1, -1};
+    for (int v = 0; v < 256; v++) {
+        uint64_t count = load(&t->traps[v]);
+        if (!count) {
+            continue;
+        }
+        for (int i = 0; i < 3; i++) {
+            if (used[i] < 0 || count > load(&t->traps[used[i]])) {
+                memmove(used + i + 1, used + i, (2 - i) * sizeof(int));
+                used[i] = v;
+                break;
+            }
+        }
+    }
+    out[0] = 0;
+    for (int i = 0; i < 3 && used[i] >= 0; i++) {
+        size_t len = strlen(out);
+        snprintf(out + len, size - len, "%sx%02X:%llu", i ? " " : "", used[i], (unsigned long long)load(&t->traps[used[i]]));
+    }
+}
+
+static void sample_vm(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    /* vm that is starting has created the file but not sized it yet, touching the mapping past its end faults */
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct telemetry)) {
+        close(fd);
+        return;
+    }
+    struct telemetry* t = mmap(NULL, sizeof(struct telemetry), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (t == MAP_FAILED) {
+        return;
+    }
+    if (atomic_load_explicit(&t->magic, memory_order_acquire) != TELEMETRY_MAGIC || t->version != TELEMETRY_VERSION) {
+        munmap(t, sizeof(struct telemetry));
+        return;
+    }
+    const char* state = "run";
+    uint64_t ips = load(&t->instructions_per_second);
+    if (kill(t->pid, 0) < 0 && errno == ESRCH) {
+        state = "dead";
+        ips = 0;
+        /* vm was killed before it could remove its file, it is shown this once */
+        unlink(path);
+    } else if (now_ns() - load(&t->updated_ns) > IDLE_NS) {
+        state = "idle";
+        ips = 0;
+    }
+    char traps[64];
+    format_traps(t, traps, sizeof(traps));
+    printf("%7d %-4s x%04X %14llu %12llu %10llu %8llu %8llu  %-26s %s\n", t->pid, state, (unsigned)load(&t->pc),
+           (unsigned long long)load(&t->instructions), (unsigned long long)ips, (unsigned long long)load(&t->kbsr_polls),
+           (unsigned long long)load(&t->bytes_in), (unsigned long long)load(&t->bytes_out), traps, t->image);
+    munmap(t, sizeof(struct telemetry));
+}
+
+static void sample_all() {
+    DIR* dir = opendir(TELEMETRY_DIR);
+    if (!dir) {
+        return;
+    }
+    printf("%7s %-4s %5s %14s %12s %10s %8s %8s  %-26s %s\n", "PID", "STAT", "PC", "INSTR", "IPS", "KBSR", "IN", "OUT", "TRAPS",
+           "IMAGE");
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (strncmp(entry->d_name, TELEMETRY_PREFIX, strlen(TELEMETRY_PREFIX))) {
+            continue;
+        }
+        char path[512];
+        snprintf(path, sizeof(path), TELEMETRY_DIR "/%s", entry->d_name);
+        sample_vm(path);
+    }
+    closedir(dir);
+}
+
+int main(int argc, const char* argv[]) {
+    double delay = 1.0;
+    long iterations = -1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            delay = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atol(argv[++i]);
+        } else {
+            printf("lc3-top [-d delay-seconds] [-n iterations]\n");
+            return 2;
+        }
+    }
+    int interactive = isatty(STDOUT_FILENO) && iterations != 1;
+    while (iterations < 0 || iterations-- > 0) {
+        if (interactive) {
+            printf("\033[H\033[2J");
+        }
+        sample_all();
+        fflush(stdout);
+        if (iterations) {
+            usleep((useconds_t)(delay * 1000000));
+        }
+    }
+    return 0;
+}
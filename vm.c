@@ -1,20 +1,44 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <string.h>
 
+#include "./core/block-device.h"
+#include "./core/container.h"
+#include "./core/console.h"
 #include "./core/core.h"
 #include "./core/input-buffering.h"
+#include "./core/interrupt.h"
 #include "./core/read-image.h"
+#include "./core/telemetry.h"
+#include "analysis.h"
+#include "idiom.h"
 #include "instruction-set.h"
+#include "lanes.h"
+#include "lockstep.h"
+#include "native-traps.h"
 
 /*
  * Function to abort the program in between if any exception occured or some wrong instruction is being send
  */
 void abort_program(uint16_t ret) {
+    console_sync();
     printf("Program Exitted with %d", ret);
     exit(ret);
 }
 
+/* name faulting address after symbol from container image if there is one */
+static void report_location(const char* what, uint16_t address) {
+    uint16_t offset;
+    const char* symbol = image_symbol(address, &offset);
+    if (symbol) {
+        printf("%s at x%04X (%s+%u)\n", what, address, symbol, offset);
+    } else {
+        printf("%s at x%04X\n", what, address);
+    }
+}
+
 int extecute() {
     int running = 1;
     uint16_t instr = mem_read(reg[R_PC]++);
@@ -77,28 +101,189 @@ int extecute() {
             running = op_trap(instr);
             break;
         }
-        case OP_RES: /* 1000 -> 8 */
-        case OP_RTI: /* 1101 -> 13 */
+        case OP_RTI: { /* 1000 -> 8 */
+            if (!op_return_from_interrupt(instr)) {
+                report_location("RTI in user mode", reg[R_PC] - 1);
+                abort_program(1);
+            }
+            break;
+        }
+        case OP_RES: /* 1101 -> 13 */
         default: {
-            abort_program(1);
+            if (!interrupt_exception(INT_ILLEGAL_OPCODE)) {
+                report_location("illegal opcode", reg[R_PC] - 1);
+                abort_program(1);
+            }
             break;
         }
     }
     return running;
 }
-void setup_vm() {
+/* instructions run by the interpreter, native loops count theirs in idiom_retired */
+static uint64_t instruction_number;
+
+static void publish_idle() {
+    telemetry_publish_idle(instruction_number + idiom_retired, reg[R_PC]);
+}
+
+/*
+ * Engines for lockstep mode, both run extecute, reference has idiom recognition switched off
+ */
+static int interpret_step(uint64_t* retired) {
+    uint64_t before = idiom_retired;
+    int running = extecute() && (memory[MR_MCR] >> 15);
+    *retired = 1 + idiom_retired - before;
+    return running;
+}
+
+static void reference_setup() {
+    memset(idiom_map, 0, sizeof(idiom_map));
+}
+
+static const struct engine engines[] = {
+    {"reference", reference_setup, interpret_step},
+    {"idiom", idiom_scan, interpret_step},
+};
+
+static const struct engine* lockstep_engine;
+static int lockstep_mode = CHECKPOINT_INSTRUCTION;
+static uint64_t lockstep_every;
+static const char* lockstep_input;
+
+static int lane_count;
+/* options lanes don't support, see lanes.h */
+static int lane_conflicts;
+static const char* lane_input;
+static const char* lane_output;
+
+static const struct engine* find_engine(const char* name) {
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(engines[i].name, name) == 0) {
+            return &engines[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Mark idiom loop heads, from sidecar written by lc3-analyze when there is an up to date one
+ * it lists every backward branch target so only those are matched instead of all of memory,
+ * code behind unresolved indirect jumps wasn't seen by analysis so whole memory is scanned then
+ */
+/* images are hashed only here, a vm running without idioms never reads them twice */
+static void prewarm(const char* images[], int count) {
+    uint64_t image_hash = CONTAINER_HASH_SEED;
+    for (int i = 0; i < count; i++) {
+        image_hash = analysis_hash_file(image_hash, images[i]);
+    }
+    char path[4096];
+    struct analysis analysis;
+    snprintf(path, sizeof(path), "%s%s", images[0], ANALYSIS_SUFFIX);
+    if (analysis_load(&analysis, path, image_hash) && !analysis.header.indirect_count && !analysis.header.vector_count) {
+        idiom_scan_heads(analysis.loops, analysis.header.loop_count);
+    } else {
+        idiom_scan();
+    }
+    analysis_free(&analysis);
+}
+
+void setup_vm(int argc, const char* argv[]) {
     signal(SIGINT, handle_interrupt);
+    /* exit through atexit handlers so the telemetry file is removed */
+    signal(SIGTERM, handle_interrupt);
     disable_input_buffering();
+    device_setup();
+    interrupt_setup();
+    trap_setup();
 
-    // if (argc < 2) {
-    //     /* show usage string */
-    //     printf("lc3 [image-file1] ...\n");
-    //     exit(2);
-    // }
     const char* filename = "/Users/evendead/Downloads/2048.obj";
-    if (!read_image(filename)) {
-        printf("failed to load image: %s\n", filename);
-        abort_program(1);
+    const char* image_files[argc];
+    int images = 0;
+    int idioms = 1;
+    int publish = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--disk") == 0 && i + 1 < argc) {
+            lane_conflicts++;
+            if (!block_device_open(argv[++i])) {
+                printf("failed to open disk: %s\n", argv[i]);
+                abort_program(1);
+            }
+        } else if (strcmp(argv[i], "--native-traps") == 0) {
+            lane_conflicts++;
+            native_trap_setup();
+        } else if (strcmp(argv[i], "--no-idioms") == 0) {
+            idioms = 0;
+        } else if (strcmp(argv[i], "--no-telemetry") == 0) {
+            publish = 0;
+        } else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc && find_engine(argv[i + 1])) {
+            lockstep_engine = find_engine(argv[++i]);
+            lane_conflicts++;
+            publish = 0;
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "instr") == 0) {
+                lockstep_mode = CHECKPOINT_INSTRUCTION;
+            } else if (strcmp(argv[i], "block") == 0) {
+                lockstep_mode = CHECKPOINT_BLOCK;
+            } else {
+                char* end;
+                lockstep_mode = CHECKPOINT_EVERY;
+                lockstep_every = strtoull(argv[i], &end, 0);
+                if (end == argv[i] || *end || argv[i][0] == '-' || !lockstep_every) {
+                    printf("--checkpoint takes instr, block or a positive instruction count: %s\n", argv[i]);
+                    abort_program(2);
+                }
+            }
+        } else if (strcmp(argv[i], "--coalesce") == 0 && i + 1 < argc) {
+            console_coalesce(atoi(argv[++i]));
+            lane_conflicts++;
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            lockstep_input = argv[++i];
+        } else if (strcmp(argv[i], "--lanes") == 0 && i + 1 < argc) {
+            lane_count = atoi(argv[++i]);
+            publish = 0;
+        } else if (strcmp(argv[i], "--lane-input") == 0 && i + 1 < argc) {
+            lane_input = argv[++i];
+        } else if (strcmp(argv[i], "--lane-output") == 0 && i + 1 < argc) {
+            lane_output = argv[++i];
+        } else if (argv[i][0] == '-') {
+            /* show usage string */
+            printf("lc3 [--disk disk-file] [--native-traps] [--no-idioms] [--no-telemetry] [--coalesce fps] [image-file1] ...\n");
+            printf("lc3 --lockstep reference|idiom [--checkpoint instr|block|N] [--input file] [image-file1] ...\n");
+            printf("lc3 --lanes N --lane-input input%%d [--lane-output output%%d] [image-file1] ...\n");
+            abort_program(2);
+        } else {
+            if (!read_image(argv[i])) {
+                printf("failed to load image: %s\n", argv[i]);
+                abort_program(1);
+            }
+            if (!images) {
+                filename = argv[i];
+            }
+            image_files[images++] = argv[i];
+        }
+    }
+    if (lane_count && !lane_input) {
+        printf("--lanes needs --lane-input\n");
+        abort_program(2);
+    }
+    if (lane_count && lane_conflicts) {
+        printf("--lanes can't be combined with --disk, --native-traps, --lockstep or --coalesce\n");
+        abort_program(2);
+    }
+    if (!images) {
+        if (!read_image(filename)) {
+            printf("failed to load image: %s\n", filename);
+            abort_program(1);
+        }
+        image_files[images++] = filename;
+    }
+    if (idioms) {
+        prewarm(image_files, images);
+    }
+    /* telemetry is best effort, vm runs the same without /dev/shm */
+    if (publish) {
+        telemetry_open(filename);
     }
     /* excatly one condition flag can be set at a given time intital value to Z*/
     reg[R_COND] = FL_ZRO;
@@ -108,13 +293,35 @@ void setup_vm() {
 }
 
 int main(int argc, const char* argv[]) {
-    setup_vm();
+    setup_vm(argc, argv);
+    if (lockstep_engine) {
+        int diverged = lockstep_run(&engines[0], lockstep_engine, lockstep_mode, lockstep_every, lockstep_input);
+        block_device_close();
+        restore_input_buffering();
+        return diverged;
+    }
+    if (lane_count) {
+        int faults = lanes_run(lane_count, lane_input, lane_output);
+        block_device_close();
+        restore_input_buffering();
+        return faults;
+    }
     int running = 1;
-    int instruction_number = 1;
+    device_on_idle(publish_idle);
+    /* keyboard & timer are polled & telemetry is published every DEVICE_POLL_INTERVAL instructions */
     while (running) {
-        running = extecute();
+        running = extecute() && (memory[MR_MCR] >> 15);
         instruction_number++;
+        if (!(instruction_number & (DEVICE_POLL_INTERVAL - 1))) {
+            device_poll();
+            telemetry_publish(instruction_number + idiom_retired, reg[R_PC]);
+        }
+        if (interrupt_pending) {
+            interrupt_service();
+        }
     }
+    telemetry_publish(instruction_number + idiom_retired, reg[R_PC]);
+    block_device_close();
     restore_input_buffering();
     return 0;
 }